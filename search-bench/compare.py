@@ -0,0 +1,183 @@
+#! /usr/bin/env python3
+"""Compare two sweep results databases cell by cell.
+
+Cells of the base and the new database are matched by their parameters,
+leaving out the binary so that two builds can be compared.  For each
+metric the repeats of a cell are compared with a two-sided Mann-Whitney
+U test, and a cell regressed when the difference is significant and the
+median moved the wrong way by more than the threshold.  The exit status
+is 1 when a cell regressed, so the comparison can gate a change:
+
+    sweep.py run --db base.jsonl --bin ./search-x86.base --repeats 10 ...
+    sweep.py run --db new.jsonl --bin ./search-x86 --repeats 10 ...
+    compare.py base.jsonl new.jsonl --metric bmtime lat_p99 --threshold 5
+
+The smallest two-sided p value of n1 and n2 repeats is 2 / C(n1 + n2, n1),
+so 3 repeats a side cannot reach alpha 0.05.  Such cells are flagged
+"too few" instead, and the status is 2 when no cell could reach alpha.
+"""
+
+import argparse
+import math
+import sys
+
+import sweep
+
+
+def cell_match_key(c, with_cmd):
+    return sweep.cell_key(c if with_cmd else dict(c, cmd="")).strip()
+
+
+def samples(runs, with_cmd, metric):
+    """match key -> values of metric over the successful repeats"""
+    res = {}
+    for key in runs:
+        ok = sweep.ok_runs(runs, key)
+        if not ok:
+            continue
+        xs = [r["result"][metric] for r in ok
+              if isinstance(r["result"].get(metric), (int, float))]
+        if xs:
+            res.setdefault(cell_match_key(ok[0]["cell"], with_cmd),
+                           []).extend(xs)
+    return res
+
+
+def median(xs):
+    xs = sorted(xs)
+    n = len(xs)
+    return (xs[(n - 1) // 2] + xs[n // 2]) / 2.0
+
+
+def ranks(xs):
+    """average ranks, 1 based, and the tie correction sum of t^3 - t"""
+    order = sorted(range(len(xs)), key=lambda i: xs[i])
+    r = [0.0] * len(xs)
+    ties = 0
+    i = 0
+    while i < len(order):
+        j = i
+        while j + 1 < len(order) and xs[order[j + 1]] == xs[order[i]]:
+            j += 1
+        for k in range(i, j + 1):
+            r[order[k]] = (i + j) / 2.0 + 1
+        t = j - i + 1
+        ties += t ** 3 - t
+        i = j + 1
+    return r, ties
+
+
+def u_exact_cdf(n1, n2):
+    """P(U <= u) for u = 0..n1*n2, without ties"""
+    # f[n][m][u]: arrangements of n and m values with statistic u
+    f = [[None] * (n2 + 1) for _ in range(n1 + 1)]
+    for n in range(n1 + 1):
+        for m in range(n2 + 1):
+            if n == 0 or m == 0:
+                f[n][m] = [1]
+                continue
+            a = f[n - 1][m]     # largest value from the first sample
+            b = f[n][m - 1]
+            c = [0] * (n * m + 1)
+            for u, x in enumerate(b):
+                c[u] += x
+            for u, x in enumerate(a):
+                c[u + m] += x
+            f[n][m] = c
+    counts = f[n1][n2]
+    total = float(sum(counts))
+    cdf, s = [], 0
+    for x in counts:
+        s += x
+        cdf.append(s / total)
+    return cdf
+
+
+def mann_whitney(xs, ys):
+    """two-sided p value of the Mann-Whitney U test"""
+    n1, n2 = len(xs), len(ys)
+    r, ties = ranks(list(xs) + list(ys))
+    u1 = sum(r[:n1]) - n1 * (n1 + 1) / 2.0
+    u = min(u1, n1 * n2 - u1)
+    if ties == 0 and n1 <= 20 and n2 <= 20:
+        return min(1.0, 2 * u_exact_cdf(n1, n2)[int(u)])
+    n = n1 + n2
+    var = n1 * n2 / 12.0 * ((n + 1) - ties / float(n * (n - 1)))
+    if var <= 0:
+        return 1.0
+    z = (n1 * n2 / 2.0 - u - 0.5) / math.sqrt(var)   # continuity
+    return min(1.0, math.erfc(max(z, 0) / math.sqrt(2)))
+
+
+def min_p(n1, n2):
+    """smallest two-sided p value of samples of n1 and n2 values"""
+    f = math.factorial
+    return min(1.0, 2.0 * f(n1) * f(n2) / f(n1 + n2))
+
+
+def compare(base, new, metric, threshold, alpha, higher_better, with_cmd):
+    """rows of (cell, base median, new median, change %, p, verdict)"""
+    b = samples(base, with_cmd, metric)
+    n = samples(new, with_cmd, metric)
+    rows = []
+    for key in sorted(set(b) & set(n)):
+        mb, mn = median(b[key]), median(n[key])
+        change = (mn - mb) / mb * 100 if mb else 0.0
+        worse = -change if higher_better else change
+        p = mann_whitney(b[key], n[key])
+        verdict = ""
+        if min_p(len(b[key]), len(n[key])) >= alpha:
+            verdict = "too few"
+        elif p < alpha and worse > threshold:
+            verdict = "REGRESSED"
+        elif p < alpha and worse < -threshold:
+            verdict = "improved"
+        rows.append((key, mb, mn, change, p, len(b[key]), len(n[key]),
+                     verdict))
+    return rows
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("base")
+    ap.add_argument("new")
+    ap.add_argument("--metric", nargs="+", default=["bmtime"])
+    ap.add_argument("--threshold", type=float, default=5.0,
+                    help="change of the median in percent, 5 by default")
+    ap.add_argument("--alpha", type=float, default=0.05)
+    ap.add_argument("--higher-is-better", nargs="*", default=[],
+                    metavar="METRIC",
+                    help="metrics where larger is better, e.g. throughput")
+    ap.add_argument("--with-cmd", action="store_true",
+                    help="match cells on the binary too")
+    ap.add_argument("--all", action="store_true",
+                    help="print the unchanged cells too")
+    a = ap.parse_args()
+
+    base, new = sweep.load_db(a.base), sweep.load_db(a.new)
+    regressed = compared = few = 0
+    for metric in a.metric:
+        rows = compare(base, new, metric, a.threshold, a.alpha,
+                       metric in a.higher_is_better, a.with_cmd)
+        compared += len(rows)
+        for (key, mb, mn, change, p, nb, nn, verdict) in rows:
+            regressed += verdict == "REGRESSED"
+            few += verdict == "too few"
+            if verdict or a.all:
+                print("%-9s %-12s %12.3f -> %12.3f %+7.2f%% p=%.4f (n=%d/%d) %s"
+                      % (verdict or "same", metric, mb, mn, change, p, nb, nn,
+                         key))
+    if not compared:
+        print("no common cells")
+        return 2
+    print("%d cells compared, %d regressed" % (compared, regressed))
+    if few:
+        print("warning: %d cells have too few repeats to reach p < %g"
+              % (few, a.alpha), file=sys.stderr)
+    if regressed:
+        return 1
+    return 2 if few == compared else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -53,4 +53,37 @@ extern size_t __libc_ifunc_impl_list (const char *name,
 				      struct libc_ifunc_impl *array,
 				      size_t max);
 
+#ifndef attribute_hidden
+# define attribute_hidden
+#endif
+
+#ifdef KMEMCMP_H_
+/* The kmemcmp variants of kmemcmp.h, for a test that includes it
+   before this file.  */
+size_t
+__libc_ifunc_impl_list (const char *name, struct libc_ifunc_impl *array,
+			size_t max)
+{
+  size_t i = 0;
+
+  IFUNC_IMPL (i, name, kmemcmp,
+	      IFUNC_IMPL_ADD (array, i, kmemcmp, 1, kmemcmp_generic)
+#if defined(__x86_64__)
+	      IFUNC_IMPL_ADD (array, i, kmemcmp,
+			      __builtin_cpu_supports ("sse2"), kmemcmp_sse2)
+	      IFUNC_IMPL_ADD (array, i, kmemcmp,
+			      __builtin_cpu_supports ("avx2"), kmemcmp_avx2)
+	      IFUNC_IMPL_ADD (array, i, kmemcmp,
+			      __builtin_cpu_supports ("avx512f")
+			      && __builtin_cpu_supports ("avx512bw"),
+			      kmemcmp_avx512)
+#elif defined(__K1__)
+	      IFUNC_IMPL_ADD (array, i, kmemcmp, 1, kmemcmp_k1)
+#endif
+	      );
+
+  return i;
+}
+#endif
+
 #endif /* ifunc-impl-list.h */
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 static inline
 int jsmemcmp(void * s1, void * s2, unsigned n)
@@ -22,8 +23,164 @@ int jsmemcmp(void * s1, void * s2, unsigned n)
   return (u1 > u2) - (u1 < u2);
 }
 
+/* kmemcmp() variants.
+ * They only tell whether the n bytes at s1 and s2 are equal, 0 if they
+ * are and nonzero if not, and never read outside of the n bytes.  The
+ * generic one compares a word at a time as jsmemcmp() does, the x86
+ * ones a vector at a time with SSE2, AVX2 or AVX-512 and kmemcmp() is
+ * the best of them for the CPU, picked at load time by an ifunc
+ * resolver.  On K1 kmemcmp() is the assembly one, kmemcmp_k1(). */
 static inline
-int kmemcmp(const void *s1, const void *s2, size_t n)
+int kmemcmp_generic(const void *s1, const void *s2, size_t n)
+{
+  const char *p1 = s1, *p2 = s2;
+  uint64_t u1, u2;
+  uint32_t w1, w2;
+  size_t i;
+
+  if (n < 8) {
+    if (n >= 4) {
+      /* first and last 4 bytes, which overlap */
+      memcpy(&w1, p1, 4);
+      memcpy(&w2, p2, 4);
+      memcpy(&u1, p1 + n - 4, 4);
+      memcpy(&u2, p2 + n - 4, 4);
+      return (w1 ^ w2) | ((uint32_t)u1 ^ (uint32_t)u2);
+    }
+    if (n == 0)
+      return 0;
+    return (p1[0] ^ p2[0]) | (p1[n / 2] ^ p2[n / 2]) | (p1[n - 1] ^ p2[n - 1]);
+  }
+  for (i = 0; i + 32 <= n; i += 32) {
+    uint64_t a[4], b[4];
+
+    memcpy(a, p1 + i, 32);
+    memcpy(b, p2 + i, 32);
+    if ((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a[2] ^ b[2]) | (a[3] ^ b[3]))
+      return 1;
+  }
+  for (; i + 8 <= n; i += 8) {
+    memcpy(&u1, p1 + i, 8);
+    memcpy(&u2, p2 + i, 8);
+    if (u1 != u2)
+      return 1;
+  }
+  if (i == n)
+    return 0;
+  /* the last word overlaps the previous one */
+  memcpy(&u1, p1 + n - 8, 8);
+  memcpy(&u2, p2 + n - 8, 8);
+  return u1 != u2;
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+__attribute__((target("sse2"))) static inline
+int kmemcmp_sse2(const void *s1, const void *s2, size_t n)
+{
+  const char *p1 = s1, *p2 = s2;
+  __m128i d;
+  size_t i;
+
+  if (n < 16)
+    return kmemcmp_generic(s1, s2, n);
+  for (i = 0; i + 64 <= n; i += 64) {
+#define XOR(x)  _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p1 + i + x)), \
+                              _mm_loadu_si128((const __m128i *)(p2 + i + x)))
+    d = _mm_or_si128(_mm_or_si128(XOR(0), XOR(16)), _mm_or_si128(XOR(32), XOR(48)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(d, _mm_setzero_si128())) != 0xffff)
+      return 1;
+  }
+  for (; i + 16 <= n; i += 16) {
+    d = XOR(0);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(d, _mm_setzero_si128())) != 0xffff)
+      return 1;
+  }
+#undef XOR
+  if (i == n)
+    return 0;
+  d = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p1 + n - 16)),
+                    _mm_loadu_si128((const __m128i *)(p2 + n - 16)));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(d, _mm_setzero_si128())) != 0xffff;
+}
+
+__attribute__((target("avx2"))) static inline
+int kmemcmp_avx2(const void *s1, const void *s2, size_t n)
+{
+  const char *p1 = s1, *p2 = s2;
+  __m256i d;
+  size_t i;
+
+  if (n < 32)
+    return kmemcmp_sse2(s1, s2, n);
+  for (i = 0; i + 128 <= n; i += 128) {
+#define XOR(x)  _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p1 + i + x)), \
+                                 _mm256_loadu_si256((const __m256i *)(p2 + i + x)))
+    d = _mm256_or_si256(_mm256_or_si256(XOR(0), XOR(32)),
+                        _mm256_or_si256(XOR(64), XOR(96)));
+    if (!_mm256_testz_si256(d, d))
+      return 1;
+  }
+  for (; i + 32 <= n; i += 32) {
+    d = XOR(0);
+    if (!_mm256_testz_si256(d, d))
+      return 1;
+  }
+#undef XOR
+  if (i == n)
+    return 0;
+  d = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p1 + n - 32)),
+                       _mm256_loadu_si256((const __m256i *)(p2 + n - 32)));
+  return !_mm256_testz_si256(d, d);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static inline
+int kmemcmp_avx512(const void *s1, const void *s2, size_t n)
+{
+  const char *p1 = s1, *p2 = s2;
+  __mmask64 m;
+  size_t i;
+
+  for (i = 0; i + 256 <= n; i += 256) {
+#define NE(x)  _mm512_cmpneq_epi64_mask(_mm512_loadu_si512(p1 + i + x), \
+                                        _mm512_loadu_si512(p2 + i + x))
+    if (NE(0) | NE(64) | NE(128) | NE(192))
+      return 1;
+  }
+  for (; i + 64 <= n; i += 64) {
+    if (NE(0))
+      return 1;
+  }
+#undef NE
+  if (i == n)
+    return 0;
+  /* masked loads of the tail, nothing past it is read */
+  m = ~(__mmask64)0 >> (64 - (n - i));
+  return _mm512_mask_cmpneq_epi8_mask(m, _mm512_maskz_loadu_epi8(m, p1 + i),
+                                      _mm512_maskz_loadu_epi8(m, p2 + i)) != 0;
+}
+
+static int (*resolve_kmemcmp(void))(const void *, const void *, size_t)
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+    return kmemcmp_avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return kmemcmp_avx2;
+  return kmemcmp_sse2;
+}
+
+static int kmemcmp(const void *s1, const void *s2, size_t n)
+  __attribute__((ifunc("resolve_kmemcmp"), unused));
+
+#elif !defined(__K1__)
+#define kmemcmp kmemcmp_generic
+#endif
+
+#if defined(__K1__)
+static inline
+int kmemcmp_k1(const void *s1, const void *s2, size_t n)
 {
   const uint64_t *u1 = (void *)s1;
   const uint64_t *u2 = (void *)s2;
@@ -214,6 +371,91 @@ int kmemcmp(const void *s1, const void *s2, size_t n)
 
 #undef USZ
 
+static inline
+int kmemcmp(const void *s1, const void *s2, size_t n)
+{
+  return kmemcmp_k1(s1, s2, n);
+}
+#endif	/* __K1__ */
+
+/* kmemeq() tells whether the n bytes at s1 and s2 are equal, 1 if they
+ * are.  kmemeq_8() ... kmemeq_100() do the same for the key sizes the
+ * benchmarks use, with n known at compile time, so the word compares of
+ * kmemeq_n() are fully unrolled and the tail needs no length check.
+ * Keys of 256 bytes and more go to the kmemcmp() of the CPU, so there
+ * is no kmemeq_N() for them. */
+static inline __attribute__((always_inline))
+int kmemeq_n(const void *s1, const void *s2, size_t n)
+{
+  const char *p1 = s1, *p2 = s2;
+  uint64_t a[4], b[4], d;
+  uint32_t w1, w2, w3, w4;
+  size_t i;
+
+  if (n < 8) {
+    if (n < 4)
+      return n == 0 || ((p1[0] ^ p2[0]) | (p1[n / 2] ^ p2[n / 2]) |
+                        (p1[n - 1] ^ p2[n - 1])) == 0;
+    memcpy(&w1, p1, 4);
+    memcpy(&w2, p2, 4);
+    memcpy(&w3, p1 + n - 4, 4);
+    memcpy(&w4, p2 + n - 4, 4);
+    return ((w1 ^ w2) | (w3 ^ w4)) == 0;
+  }
+  if (n >= 256)
+    return kmemcmp(s1, s2, n) == 0;	/* as wide as the CPU goes */
+  i = 0;
+#if defined(__x86_64__)
+  /* SSE2 is always there on x86-64 */
+  for (; i + 64 <= n; i += 64) {
+    __m128i v;
+#define XOR(x)  _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p1 + i + x)), \
+                              _mm_loadu_si128((const __m128i *)(p2 + i + x)))
+    v = _mm_or_si128(_mm_or_si128(XOR(0), XOR(16)), _mm_or_si128(XOR(32), XOR(48)));
+#undef XOR
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xffff)
+      return 0;
+  }
+#endif
+  for (; i + 32 <= n; i += 32) {
+    memcpy(a, p1 + i, 32);
+    memcpy(b, p2 + i, 32);
+    if ((a[0] ^ b[0]) | (a[1] ^ b[1]) | (a[2] ^ b[2]) | (a[3] ^ b[3]))
+      return 0;
+  }
+  d = 0;
+  for (; i + 8 <= n; i += 8) {
+    memcpy(a, p1 + i, 8);
+    memcpy(b, p2 + i, 8);
+    d |= a[0] ^ b[0];
+  }
+  if (i < n) {
+    /* the last word overlaps the previous one */
+    memcpy(a, p1 + n - 8, 8);
+    memcpy(b, p2 + n - 8, 8);
+    d |= a[0] ^ b[0];
+  }
+  return d == 0;
+}
+
+#define KMEMEQ(n) \
+  static inline int kmemeq_ ## n (const void *s1, const void *s2) \
+  { \
+    return kmemeq_n(s1, s2, n); \
+  }
+KMEMEQ(8)
+KMEMEQ(10)
+KMEMEQ(16)
+KMEMEQ(32)
+KMEMEQ(100)
+#undef KMEMEQ
+
+static inline
+int kmemeq(const void *s1, const void *s2, size_t n)
+{
+  return kmemcmp(s1, s2, n) == 0;
+}
+
 #endif	/* KMEMCMP_H_ */
 
 
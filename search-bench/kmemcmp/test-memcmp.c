@@ -20,11 +20,13 @@
 
 #define _GNU_SOURCE
 #define TEST_MAIN
+#define TEST_NAME "kmemcmp"
 #define RELAXED
 
 # include <limits.h>
-#include "test-string.h"
+/* before test-string.h, for the kmemcmp variants of ifunc-impl-list.h */
 #include "kmemcmp.h"
+#include "test-string.h"
 
 //# define MEMCMP memcmp
 # define MEMCMP kmemcmp
@@ -48,8 +50,16 @@ simple_memcmp (const char *s1, const char *s2, size_t n)
 
 typedef int (*proto_t) (const CHAR *, const CHAR *, size_t);
 
+/* The C library memcmp, the baseline of the --bench timings.  */
+int
+libc_memcmp (const char *s1, const char *s2, size_t n)
+{
+  return memcmp (s1, s2, n);
+}
+
 IMPL (SIMPLE_MEMCMP, 0)
 IMPL (MEMCMP, 1)
+IMPL (libc_memcmp, 1)
 
 static int
 check_result (impl_t *impl, const CHAR *s1, const CHAR *s2, size_t len,
@@ -456,6 +466,119 @@ check2 (void)
     }
 }
 
+/* Timing mode (--bench): every implementation over a grid of lengths,
+   alignments and positions of the first difference, printed as CSV.
+   "tput" times independent compares, so the calls overlap in the
+   pipeline as they do in a scan of many records; "lat" chains every
+   compare to the result of the one before, which is the cost of a
+   compare that decides where the next one reads.  gbps is over the
+   bytes up to and including the first difference, the ones a compare
+   has to read.  */
+
+static const size_t bench_lens[] =
+  { 1, 2, 3, 4, 7, 8, 10, 15, 16, 31, 32, 63, 64, 100, 128, 255, 256,
+    512, 1024, 4096 };
+static const size_t bench_aligns[][2] =
+  { { 0, 0 }, { 0, 1 }, { 3, 3 }, { 5, 11 }, { 0, 32 } };
+/* first difference at len * num / 4, 4 is no difference */
+static const int bench_diffs[] = { 0, 1, 2, 3, 4 };
+
+/* zero, in a variable the compiler cannot see through */
+size_t bench_zero, bench_sink;
+
+static double
+bench_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double
+bench_tput (impl_t *impl, const CHAR *s1, const CHAR *s2, size_t len,
+	    size_t calls)
+{
+  unsigned int sum = 0;
+  double start;
+  size_t n;
+
+  start = bench_now ();
+  for (n = 0; n < calls; n++)
+    sum += CALL (impl, s1, s2, len);
+  bench_sink = sum;
+  return (bench_now () - start) / calls;
+}
+
+static double
+bench_lat (impl_t *impl, const CHAR *s1, const CHAR *s2, size_t len,
+	   size_t calls)
+{
+  size_t dep = bench_zero;
+  double start;
+  size_t n;
+
+  start = bench_now ();
+  for (n = 0; n < calls; n++)
+    s1 += (unsigned int) CALL (impl, s1, s2, len) & dep;
+  bench_sink = (size_t) s1;
+  return (bench_now () - start) / calls;
+}
+
+static void
+bench_one (size_t align1, size_t align2, size_t len, int diff)
+{
+  size_t i, pos, bytes, calls;
+  CHAR *s1, *s2;
+  double ns;
+
+  if (align1 + len * CHARBYTES >= page_size
+      || align2 + len * CHARBYTES >= page_size)
+    return;
+
+  s1 = (CHAR *) (buf1 + align1);
+  s2 = (CHAR *) (buf2 + align2);
+  for (i = 0; i < len; i++)
+    s1[i] = s2[i] = 1 + 23 * i % CHAR__MAX;
+  pos = len * diff / 4;
+  if (diff > 0 && pos < len && pos == len * (diff - 1) / 4)
+    return;		/* same cell as the previous position */
+  if (pos < len)
+    s2[pos] ^= 0x40;
+  /* bytes up to the first difference, which is where a compare stops */
+  bytes = pos < len ? pos + 1 : len;
+
+  /* about the same time per cell, whatever the length */
+  calls = ITERATIONS / (1 + len / 64);
+  if (calls < 100)
+    calls = 100;
+
+  FOR_EACH_IMPL (impl, 0)
+    {
+      bench_tput (impl, s1, s2, len, calls / 10);	/* warm up */
+      ns = bench_tput (impl, s1, s2, len, calls);
+      printf ("%s,tput,%zu,%zu,%zu,%zu,%.3f,%.3f\n", impl->name, len,
+	      align1, align2, pos, ns, bytes * CHARBYTES / ns);
+      ns = bench_lat (impl, s1, s2, len, calls);
+      printf ("%s,lat,%zu,%zu,%zu,%zu,%.3f,%.3f\n", impl->name, len,
+	      align1, align2, pos, ns, bytes * CHARBYTES / ns);
+    }
+}
+
+static void
+bench_grid (void)
+{
+  size_t l, a, d;
+
+  printf ("impl,mode,len,align1,align2,diff,ns,gbps\n");
+  for (l = 0; l < sizeof bench_lens / sizeof bench_lens[0]; l++)
+    for (a = 0; a < sizeof bench_aligns / sizeof bench_aligns[0]; a++)
+      for (d = 0; d < sizeof bench_diffs / sizeof bench_diffs[0]; d++)
+	bench_one (bench_aligns[a][0] * CHARBYTES,
+		   bench_aligns[a][1] * CHARBYTES, bench_lens[l],
+		   bench_diffs[d]);
+}
+
 int
 test_main (void)
 {
@@ -466,6 +589,12 @@ test_main (void)
   check1 ();
   check2 ();
 
+  if (do_bench)
+    {
+      bench_grid ();
+      return ret;
+    }
+
   printf ("%23s", "");
   FOR_EACH_IMPL (impl, 0)
     printf ("\t%s", impl->name);
@@ -60,9 +60,10 @@ extern impl_t __start_impls[], __stop_impls[];
 # define OPT_ITERATIONS 10000
 # define OPT_RANDOM 10001
 # define OPT_SEED 10002
+# define OPT_BENCH 10003
 
 unsigned char *buf1, *buf2;
-int ret, do_srandom;
+int ret, do_srandom, do_bench;
 unsigned int seed;
 size_t page_size;
 
@@ -82,7 +83,8 @@ size_t iterations = 100000;
 
 # define CMDLINE_OPTIONS ITERATIONS_OPTIONS \
   { "random", no_argument, NULL, OPT_RANDOM },	\
-  { "seed", required_argument, NULL, OPT_SEED },
+  { "seed", required_argument, NULL, OPT_SEED },	\
+  { "bench", no_argument, NULL, OPT_BENCH },
 # define CMDLINE_PROCESS ITERATIONS_PROCESS \
   case OPT_RANDOM:							\
     {									\
@@ -99,6 +101,10 @@ size_t iterations = 100000;
   case OPT_SEED:							\
     seed = strtoul (optarg, NULL, 0);					\
     do_srandom = 1;							\
+    break;								\
+									\
+  case OPT_BENCH:							\
+    do_bench = 1;							\
     break;
 
 #define CALL(impl, ...)	\
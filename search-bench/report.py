@@ -1,5 +1,7 @@
-#! /bin/python
-import subprocess
+#! /usr/bin/env python3
+import sys
+
+import sweep
 
 ## benchmark variables
 MHZ   = 500
@@ -7,40 +9,84 @@ HREP  = 100000
 K1REP = 2
 
 HOST="./search-x86"
+# extra host options, e.g. "pages=thp node=0" for huge-page/NUMA runs
+HOST_OPTS=""
 SIM='./host_main output.mpk'
-bmtime=0.0
-bytecmp=0.0
 
-def runbench(cmd, mhz, key_sz, val_sz, blk_sz, rep_cnt, dcache):
-    try:
-        out = subprocess.check_output((cmd + " %d %d %d %d %d %d") %
-                                  (mhz, key_sz, val_sz, blk_sz, rep_cnt, dcache),
-                                  shell = True)
-        c = compile(out, "dummy", "exec")
-        eval(c, globals())
-    except SyntaxError:
-        return (-1,-1)
+## sweep: results database, concurrent host cells, repeats of each cell.
+## An interrupted report resumes from the database.  The K1 simulator
+## cells always run one at a time.
+DB      = "report.jsonl"
+JOBS    = 1
+REPEATS = 1
 
-    return (bmtime, bytecmp)
+## workload spec, besides key_sz, val_sz and blk_sz any entry is passed
+## as a name=value parameter, e.g. {"kdist": "zipf", "hit": 90}
+WORKLOAD = {}
 
-# the headings of the CSV file
-print "K1 processor MHZ ", MHZ
-print "blk size, key size, value size, bytes compared, host lat (no dcache), host latency, k1 latency, x factor, x factor (no dcache)"
+def wlopts(wl):
+    opts = ""
+    for name in sorted(wl):
+        if name not in ("key_sz", "val_sz", "blk_sz"):
+            opts += " %s=%s" % (name, wl[name])
+    return opts
+
+def cells(key_sz, value_sz, blk_sz):
+    wl = dict(WORKLOAD, key_sz=key_sz, val_sz=value_sz, blk_sz=blk_sz)
+    opts = wlopts(wl) + " " + HOST_OPTS
+    return {"h":  sweep.cell(HOST, key_sz, value_sz, blk_sz, HREP, 0, opts + " lat=1", MHZ),
+            "k":  sweep.cell(SIM, key_sz, value_sz, blk_sz, K1REP, 0, wlopts(wl), MHZ),
+            "h2": sweep.cell(HOST, key_sz, value_sz, blk_sz, HREP, 1, opts, MHZ),
+            "hi": sweep.cell(HOST, key_sz, value_sz, blk_sz, HREP, 0, opts + " keyidx=2", MHZ)}
+
+def mean(runs, c, name):
+    s = sweep.summary(runs, sweep.cell_key(c))
+    if name not in s:
+        return -1
+    return s[name][0]
+
+def failure(runs, c):
+    """What went wrong with the last run of cell c"""
+    for r in reversed(runs.get(sweep.cell_key(c), [])):
+        if not r["ok"]:
+            return r.get("error", "failed")
+    return "no run"
 
+matrix = []
 for blk_sz in [16*1024, 64*1024, 128*1024, 512*1024, 1024*1024]:
     for key_sz in [8, 10, 100, 512, 1024, 4*1024, 8*1024, 16*1024]:
         for value_sz in [100, 500, 1024, 32*1024, 64*1024]:
             if blk_sz < (key_sz + value_sz + 16):
                 continue
-            (h_tm, h_by) = runbench(HOST, MHZ, key_sz, value_sz, blk_sz, HREP, 0)
-            (k_tm, k_by) = runbench(SIM, MHZ, key_sz, value_sz, blk_sz, K1REP, 0)
-            (h2_tm, h2_by) = runbench(HOST, MHZ, key_sz, value_sz, blk_sz, HREP, 1)
-            if k_by != -1:
-                assert(h_by == k_by)
-                h_lat = h_tm/HREP
-                k_lat = k_tm/K1REP
-                h2_lat = h2_tm/HREP
-                print "%d, %d, %d, %d, %f, %f, %f, %f, %f"%(blk_sz, key_sz, value_sz, h_by,
-                                                            h2_lat,h_lat, k_lat, k_lat/h_lat, k_lat/h2_lat)
-            else:
-                print "Test failed on K1 (Out of memory): %d, %d, %d"%(blk_sz, key_sz, value_sz)
+            matrix.append((blk_sz, key_sz, value_sz, cells(key_sz, value_sz, blk_sz)))
+
+sweep.run_sweep([m[3][t] for m in matrix for t in ("h", "h2", "hi")],
+                DB, JOBS, REPEATS)
+runs = sweep.run_sweep([m[3]["k"] for m in matrix], DB, 1, REPEATS)
+
+# the headings of the CSV file
+print("K1 processor MHZ ", MHZ)
+print("host options ", HOST_OPTS)
+print("workload ", wlopts(WORKLOAD))
+print("blk size, key size, value size, bytes compared, host lat (no dcache), host latency, k1 latency, x factor, x factor (no dcache), host keyidx latency, keyidx speedup, host p50 (ns), host p90 (ns), host p99 (ns), host p999 (ns), host max (ns)")
+
+for (blk_sz, key_sz, value_sz, c) in matrix:
+    h_by = mean(runs, c["h"], "bytecmp")
+    k_by = mean(runs, c["k"], "bytecmp")
+    if k_by != -1 and h_by != -1:
+        assert(h_by == k_by)
+        h_lat = mean(runs, c["h"], "bmtime")/HREP
+        k_lat = mean(runs, c["k"], "bmtime")/K1REP
+        h2_lat = mean(runs, c["h2"], "bmtime")/HREP
+        hi_lat = mean(runs, c["hi"], "bmtime")/HREP
+        h_pct = tuple(mean(runs, c["h"], n) for n in
+                      ("lat_p50", "lat_p90", "lat_p99", "lat_p999", "lat_max"))
+        print("%d, %d, %d, %d, %f, %f, %f, %f, %f, %f, %f, %d, %d, %d, %d, %d"%((blk_sz, key_sz, value_sz, h_by,
+                                                            h2_lat,h_lat, k_lat, k_lat/h_lat, k_lat/h2_lat,
+                                                            hi_lat, h_lat/hi_lat) + h_pct))
+    else:
+        for t in ("h", "k"):
+            if mean(runs, c[t], "bytecmp") == -1:
+                print("Test failed (%s): %d, %d, %d: %s"%(c[t]["cmd"], blk_sz, key_sz, value_sz,
+                                                         failure(runs, c[t]).strip()))
+    sys.stdout.flush()
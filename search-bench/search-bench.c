@@ -1,9 +1,11 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdint.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
+#include <math.h>
 
 #ifdef __K1__
 #include <mppa_rpc.h>
@@ -19,8 +21,162 @@ typedef struct {
   // value follows key
 } region_t;
 
+/* Side index of a block: one dense entry per record */
+typedef struct {
+	uint32_t *off;   /* offset of each record from the block start */
+	uint64_t *pfx;   /* first 8 key bytes, zero padded, or NULL */
+	uint32_t *hash;  /* key_hash() of each key, or NULL */
+	int       nrec;
+	uint32_t  min_ksz;
+	uint32_t  max_ksz;
+} recidx_t;
+
 int dcache;
 
+/* Benchmark memory.
+ * The block and the cache-defeat arena come from bench_alloc(), which
+ * on x86 can back them with transparent or hugetlbfs huge pages and
+ * bind them to a NUMA node or interleave them over the allowed nodes.
+ * A policy that cannot be had falls back to the next best one, and
+ * mem_pages/mem_numa tell what was in effect. */
+#define MEM_MALLOC	0
+#define MEM_THP		1
+#define MEM_HUGETLB	2
+
+const char *mem_names[] = { "malloc", "thp", "hugetlb", NULL };
+
+int mem_pages;            /* requested page policy */
+int mem_node = -1;        /* bind to this node, -1 for no binding */
+int mem_interleave;       /* interleave over the allowed nodes */
+const char *mem_numa = "default"; /* "bind" or "interleave" when applied */
+
+#ifndef MPPA
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define HUGE_SZ		(2UL << 20)
+#define MPOL_BIND_	2
+#define MPOL_INTERLEAVE_ 3
+#define MPOL_F_MEMS_ALLOWED_ (1 << 2)
+
+static size_t
+huge_round(size_t sz)
+{
+	return (sz + HUGE_SZ - 1) & ~(HUGE_SZ - 1);
+}
+
+static void
+mem_bind(void *p, size_t sz)
+{
+	unsigned long mask = 0;
+	int           mode;
+
+	if (mem_node >= 0) {
+		if (mem_node >= (int)(8 * sizeof(mask))) {
+			mem_numa = "default";
+			return;
+		}
+		mask = 1UL << mem_node;
+		mode = MPOL_BIND_;
+	} else if (mem_interleave) {
+		if (syscall(SYS_get_mempolicy, NULL, &mask, 8 * sizeof(mask),
+			    NULL, MPOL_F_MEMS_ALLOWED_)) {
+			perror("get_mempolicy");
+			mem_numa = "default";
+			return;
+		}
+		mode = MPOL_INTERLEAVE_;
+	} else {
+		return;
+	}
+	if (syscall(SYS_mbind, p, sz, mode, &mask, 8 * sizeof(mask) + 1, 0)) {
+		perror("mbind");
+		mem_numa = "default";
+	}
+}
+
+/* set by the first bench_alloc(), fallbacks do not change it */
+static int mem_mmap = -1;
+
+void *
+bench_alloc(size_t sz)
+{
+	char   *p, *a;
+	size_t len;
+
+	if (mem_mmap < 0)
+		mem_mmap = mem_pages != MEM_MALLOC || mem_node >= 0 ||
+			mem_interleave;
+	if (!mem_mmap)
+		return malloc(sz);
+
+	len = huge_round(sz);
+	if (mem_pages == MEM_HUGETLB) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) {
+			mem_bind(p, len);
+			return p;
+		}
+		perror("mmap(MAP_HUGETLB)");
+		mem_pages = MEM_THP;
+	}
+
+	/* huge page aligned so that THP can back all of it */
+	p = mmap(NULL, len + HUGE_SZ, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	a = (char *)(((uintptr_t)p + HUGE_SZ - 1) & ~(HUGE_SZ - 1));
+	if (a > p)
+		munmap(p, a - p);
+	munmap(a + len, p + HUGE_SZ - a);
+	if (mem_pages == MEM_THP && madvise(a, len, MADV_HUGEPAGE)) {
+		perror("madvise(MADV_HUGEPAGE)");
+		mem_pages = MEM_MALLOC;
+	}
+	mem_bind(a, len);
+	return a;
+}
+
+void
+bench_free(void *p, size_t sz)
+{
+	if (!p)
+		return;
+	if (!mem_mmap)
+		free(p);
+	else
+		munmap(p, huge_round(sz));
+}
+
+/* kB of the process memory actually backed by huge pages */
+long
+mem_huge_kb(void)
+{
+	FILE *f;
+	char line[128];
+	long kb, sum = 0;
+
+	f = fopen("/proc/self/smaps_rollup", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "AnonHugePages: %ld", &kb) == 1 ||
+		    sscanf(line, "Private_Hugetlb: %ld", &kb) == 1 ||
+		    sscanf(line, "Shared_Hugetlb: %ld", &kb) == 1)
+			sum += kb;
+	}
+	fclose(f);
+	return sum;
+}
+#else
+#define bench_alloc(sz)		malloc(sz)
+#define bench_free(p, sz)	free(p)
+#define mem_huge_kb()		0L
+#endif
+
 #ifdef MPPA
 /* benchmarking functions for MPPA */
 #include <utask.h>
@@ -55,9 +211,16 @@ double usec_timer(perf_t *t) {
 	return (1.0 *(t->end - t->start))*(1e6/(1.0*CYCLES));
 }
 
+uint64_t lat_now_ns(void) {
+	return mppa_read_timer() * (1e9/(1.0*CYCLES));
+}
+
 void fix_cache(char *ptr, int sz, int cmpbytes, int cachsz) {
 }
 
+void copy_cache(char *ptr, int sz, int cmpbytes, int cachsz) {
+}
+
 char *kill_cache(char *ptr) {
 	return ptr;
 }
@@ -65,6 +228,9 @@ char *kill_cache(char *ptr) {
 
 /* benchmarking functions for x86 */
 #include "bmw_util.h"
+#include "kmemcmp/kmemcmp.h"
+#include <time.h>
+#include <immintrin.h>
 typedef struct {
   BmwClock bm;
 } perf_t;
@@ -83,6 +249,13 @@ double usec_timer(perf_t *t) {
   return bmwElapsed(&t->bm)*1e6;
 }
 
+uint64_t lat_now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 /* defeat cache in x86 */
 int  cache_num;
 char *cache_ptr;
@@ -90,34 +263,293 @@ uint64_t  rrcnt;
 int  cache_sz;
 int  cache_intrn;
 int  cache_offset;
+uint64_t  cache_alloc_sz;
+int  cache_page;	/* copy kill_cache() returned last */
+/* Copies of the keyidx side index, one per block copy, so that the
+ * index is as cold as the block it indexes.  NULL for none. */
+recidx_t *cache_ri;
+char *cache_ri_ptr;
+uint64_t  cache_ri_sz;	/* bytes of one index copy */
+
+/* Working-set models of kill_cache().
+ * wset=copy, the default, cycles over the copies of the arena, so that
+ * every lookup misses the caches.  The other models mix hot and cold
+ * blocks as a production block cache sees them:
+ *   zipf   lookups spread over wblocks copies with a Zipf popularity of
+ *          exponent wtheta/100, the popular copies stay cached.  The
+ *          copies are capped to the cache-defeat budget, so large
+ *          blocks get fewer of them
+ *   hot    whit percent of the lookups cycle over a hot set of copies,
+ *          the others over the rest of the arena.  The hot set fills a
+ *          quarter of the LLC whatever whit, so it stays cached while
+ *          whit is above about 25
+ *   flush  lookups go to one copy, whose lines are evicted with clflush
+ *          (wflush=clflushopt for clflushopt) before the lookup
+ * The copies looked up are drawn before the timed loop.  wset_hit is
+ * the hit ratio an LRU cache of llc_kb (the L3 size by default) gets on
+ * them, counting whole copies, and wset_arena_mb the memory of the
+ * copies.  The flush is paid in bmtime, the lat=1
+ * percentiles leave it out.  With dcache=1 the models are not used. */
+#define WSET_COPY	0
+#define WSET_ZIPF	1
+#define WSET_HOT	2
+#define WSET_FLUSH	3
+#define WSET_SEQ	65536	/* copies drawn, then reused */
+
+const char *wset_names[] = { "copy", "zipf", "hot", "flush", NULL };
+const char *wflush_names[] = { "clflush", "clflushopt", NULL };
+int      wset;
+int      wblocks = 1024;
+int      wtheta = 99;
+int      whit = 90;
+int      wflush;
+int      llc_kb;
+int      wset_hot;	/* copies of the hot set */
+double   wset_hit;
+uint32_t *wset_seq;
+
+/* Hit ratio of an LRU cache of cap copies on the second pass of seq */
+double
+wset_lru(uint32_t *seq, int n, int ncopy, int cap)
+{
+	int *prev, *next, *in;
+	int head = -1, tail = -1, used = 0, hits = 0;
+	int i, pass, c;
+
+	if (cap < 1)
+		return 0;
+	prev = malloc(ncopy * sizeof(int));
+	next = malloc(ncopy * sizeof(int));
+	in = calloc(ncopy, sizeof(int));
+	assert(prev && next && in);
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < n; i++) {
+			c = seq[i];
+			if (in[c]) {
+				hits += pass;
+				if (c == head)
+					continue;
+				/* unlink */
+				next[prev[c]] = next[c];
+				if (c == tail)
+					tail = prev[c];
+				else
+					prev[next[c]] = prev[c];
+			} else if (used == cap) {
+				in[tail] = 0;
+				tail = prev[tail];
+				if (tail >= 0)
+					next[tail] = -1;
+				else
+					head = -1;
+			} else {
+				used++;
+			}
+			in[c] = 1;
+			prev[c] = -1;
+			next[c] = head;
+			if (head >= 0)
+				prev[head] = c;
+			head = c;
+			if (tail < 0)
+				tail = c;
+		}
+	}
+	free(prev);
+	free(next);
+	free(in);
+	return (double)hits / n;
+}
+
+/* Draw the copies kill_cache() returns, cache_num copies are there */
+void
+wset_init(void)
+{
+	double   *cdf, sum, u;
+	uint64_t llc;
+	int      i, lo, hi, hot = 0, cold = 0;
+
+	if (!wset_seq) {
+		wset_seq = malloc(WSET_SEQ * sizeof(uint32_t));
+		assert(wset_seq);
+	}
+	llc = llc_kb ? (uint64_t)llc_kb * 1024 :
+		(uint64_t)sysconf(_SC_LEVEL3_CACHE_SIZE);
+	if (!llc)
+		llc = 8 * 1024 * 1024;
+	llc_kb = llc / 1024;
+	wset_hot = llc / 4 / cache_sz;
+	if (wset_hot > cache_num - 1)
+		wset_hot = cache_num - 1;
+	if (wset_hot < 1)
+		wset_hot = 1;
+
+	srand(3);
+	switch (wset) {
+	case WSET_ZIPF:
+		cdf = malloc(cache_num * sizeof(double));
+		assert(cdf);
+		for (sum = 0, i = 0; i < cache_num; i++) {
+			sum += pow(i + 1, -wtheta / 100.0);
+			cdf[i] = sum;
+		}
+		for (i = 0; i < WSET_SEQ; i++) {
+			u = (double)rand() / ((double)RAND_MAX + 1) * sum;
+			for (lo = 0, hi = cache_num - 1; lo < hi; ) {
+				if (cdf[(lo + hi) / 2] > u)
+					hi = (lo + hi) / 2;
+				else
+					lo = (lo + hi) / 2 + 1;
+			}
+			wset_seq[i] = lo;
+		}
+		free(cdf);
+		break;
+	case WSET_HOT:
+		for (i = 0; i < WSET_SEQ; i++) {
+			if (rand() % 100 < whit || cache_num == 1)
+				wset_seq[i] = hot++ % wset_hot;
+			else
+				wset_seq[i] = wset_hot +
+					cold++ % (cache_num - wset_hot);
+		}
+		break;
+	default:
+		for (i = 0; i < WSET_SEQ; i++)
+			wset_seq[i] = i % cache_num;
+	}
+	wset_hit = wset == WSET_FLUSH ? 0 :
+		wset_lru(wset_seq, WSET_SEQ, cache_num, llc / cache_sz);
+}
+
+static void
+wset_clflush(char *p, int sz)
+{
+	char *end = p + sz;
+
+	for (p = (char *)((uintptr_t)p & ~(uintptr_t)63); p < end; p += 64)
+		_mm_clflush(p);
+	_mm_mfence();
+}
+
+static __attribute__((target("clflushopt"))) void
+wset_clflushopt(char *p, int sz)
+{
+	char *end = p + sz;
+
+	for (p = (char *)((uintptr_t)p & ~(uintptr_t)63); p < end; p += 64)
+		_mm_clflushopt(p);
+	_mm_mfence();
+}
 
 void
 make_buf(char *buf, int size, char *target_key, int key_sz, int val_sz,
-	 int *bycmp);
+	 int *bycmp, recidx_t *ri);
 
 
+void fill_cache(char *ptr, int sz, int cmpbytes, int cachsz);
+
 void fix_cache(char *ptr, int sz, int cmpbytes, int cachsz) {
 	int cnt;
-	char *curr;
 	region_t *reg = (region_t *)ptr;
 	int bycmp;
 
 	cache_offset = offsetof(region_t, key) + reg->key_sz;
 	cache_intrn = reg->val_sz/cache_offset;
 	for (cnt = 0; cnt < cache_intrn; cnt++) {
-		make_buf(ptr + cnt*cache_offset, sz, reg->key, reg->key_sz, reg->val_sz, &bycmp);
+		make_buf(ptr + cnt*cache_offset, sz, reg->key, reg->key_sz, reg->val_sz, &bycmp, NULL);
 		assert(bycmp == cmpbytes);
 	}
+	fill_cache(ptr, sz, cmpbytes, cachsz);
+}
+
+/* Same as fix_cache() for blocks that make_buf() cannot rebuild at an
+ * inner offset, the copies are all searched from their start */
+void copy_cache(char *ptr, int sz, int cmpbytes, int cachsz) {
+	/* ptr need not start with a record, e.g. a hashed block */
+	cache_offset = 0;
+	cache_intrn = 0;
+	fill_cache(ptr, sz, cmpbytes, cachsz);
+}
+
+void
+cache_ri_free(void)
+{
+	if (!cache_ri)
+		return;
+	bench_free(cache_ri_ptr, cache_ri_sz * (cache_num + 1));
+	free(cache_ri);
+	cache_ri = NULL;
+}
+
+/* Lay out cache_num + 1 copies of the side index ri of the block, for
+ * the block copies fill_cache() made */
+void
+cache_recidx(recidx_t *ri)
+{
+	uint64_t n = ri->nrec + 1;
+	char     *curr;
+	int      cnt;
+
+	cache_ri_free();
+	cache_ri_sz = n * sizeof(*ri->off);
+	if (ri->pfx)
+		cache_ri_sz += n * sizeof(*ri->pfx);
+	if (ri->hash)
+		cache_ri_sz += n * sizeof(*ri->hash);
+	/* whole lines, so that no two copies share one */
+	cache_ri_sz = (cache_ri_sz + 63) & ~(uint64_t)63;
+	cache_ri = malloc((cache_num + 1) * sizeof(*cache_ri));
+	cache_ri_ptr = bench_alloc(cache_ri_sz * (cache_num + 1));
+	assert(cache_ri && cache_ri_ptr);
+	for (cnt = 0; cnt <= cache_num; cnt++) {
+		cache_ri[cnt] = *ri;
+		curr = cache_ri_ptr + (uint64_t)cnt * cache_ri_sz;
+		if (ri->pfx) {
+			cache_ri[cnt].pfx = (uint64_t *)curr;
+			memcpy(curr, ri->pfx, n * sizeof(*ri->pfx));
+			curr += n * sizeof(*ri->pfx);
+		}
+		cache_ri[cnt].off = (uint32_t *)curr;
+		memcpy(curr, ri->off, ri->nrec * sizeof(*ri->off));
+		curr += n * sizeof(*ri->off);
+		if (ri->hash) {
+			cache_ri[cnt].hash = (uint32_t *)curr;
+			memcpy(curr, ri->hash, n * sizeof(*ri->hash));
+		}
+	}
+}
+
+void fill_cache(char *ptr, int sz, int cmpbytes, int cachsz) {
+	int cnt;
+	char *curr;
 
 	assert(cmpbytes);
-	if (cache_intrn) {
+	/* the copies hold the blocks fix_cache() built at inner offsets */
+	cache_sz = sz + cache_intrn * cache_offset;
+	if (wset == WSET_ZIPF) {
+		cache_num = wblocks < cachsz / cache_sz ? wblocks :
+			cachsz / cache_sz;
+		if (cache_num < 1)
+			cache_num = 1;
+	} else if (wset == WSET_FLUSH) {
+		cache_num = 1;
+	} else if (cache_intrn) {
 		cache_num = cachsz/(cmpbytes * cache_intrn);
 	} else {
 		cache_num = cachsz/cmpbytes;
 	}
 
-	cache_sz = sz;
-	cache_ptr = malloc((uint64_t)sz * (cache_num + 1) + cache_offset);
+	cache_ri_free();
+	bench_free(cache_ptr, cache_alloc_sz);
+	cache_alloc_sz = (uint64_t)cache_sz * (cache_num + 1) + cache_offset;
+	cache_ptr = bench_alloc(cache_alloc_sz);
+	/* blocks with few compared bytes can ask for more copies than fit */
+	while (!cache_ptr && cache_num > 1) {
+		cache_num /= 2;
+		cache_alloc_sz = (uint64_t)cache_sz * (cache_num + 1) + cache_offset;
+		cache_ptr = bench_alloc(cache_alloc_sz);
+	}
 	assert(cache_ptr);
 	cnt = cache_num + 1;
 	curr = cache_ptr;
@@ -125,11 +557,12 @@ void fix_cache(char *ptr, int sz, int cmpbytes, int cachsz) {
 	//printf("%d %d/%d = %d\n",sz, cachsz, cmpbytes, cache_num);
 	while (cnt) {
 		//printf("%p %p %d\n", cache_ptr, curr, cnt);
-		memcpy(curr, ptr, sz);
-		curr += sz;
+		memcpy(curr, ptr, cache_sz);
+		curr += cache_sz;
 		cnt--;
 	}
 	rrcnt = 0;
+	wset_init();
 }
 
 char *kill_cache(char *ptr) {
@@ -138,17 +571,355 @@ char *kill_cache(char *ptr) {
 
 	if (dcache)
 		return ptr;
+	if (wset == WSET_FLUSH) {
+		if (wflush) {
+			wset_clflushopt(cache_ptr, cache_sz);
+			if (cache_ri)
+				wset_clflushopt(cache_ri_ptr, cache_ri_sz);
+		} else {
+			wset_clflush(cache_ptr, cache_sz);
+			if (cache_ri)
+				wset_clflush(cache_ri_ptr, cache_ri_sz);
+		}
+		cache_page = 0;
+		return cache_ptr;
+	}
+	if (wset != WSET_COPY) {
+		page = wset_seq[rrcnt++ % WSET_SEQ];
+		cache_page = page;
+		return cache_ptr + (uint64_t)page * cache_sz;
+	}
 	page = rrcnt % cache_num;
+	cache_page = page;
 	intrn = 0;
 	if (cache_intrn) {
 		intrn = (rrcnt / cache_num) % cache_intrn;
 	}
 	rrcnt++;
-	return cache_ptr + page * cache_sz + intrn;
+	return cache_ptr + (uint64_t)page * cache_sz + intrn * cache_offset;
 }
 
 #endif /* MPPA */
 
+/* Hardware counters of the timed loop.
+ * On x86 perf_event_open() counts the events of perf_names[] for this
+ * thread, user space only, as one group so that they cover the same
+ * instructions.  An event the CPU or the kernel does not give is left
+ * out of the group and reported as -1; with no counters at all, e.g.
+ * in a container or under perf_event_paranoid > 2, the run goes on
+ * with perf_events=0. */
+#define PERF_NEVENT	6
+
+const char *perf_names[PERF_NEVENT] = {
+	"cycles", "instructions", "l1d_miss", "llc_miss", "dtlb_miss",
+	"branch_miss"
+};
+
+int     use_perf = 1;
+int     perf_events;             /* events counted */
+int64_t perf_count[PERF_NEVENT]; /* -1 when not counted */
+
+#ifndef MPPA
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+
+#define PERF_CACHE(cache, res) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | ((res) << 16))
+
+static int perf_fd[PERF_NEVENT] = { -1, -1, -1, -1, -1, -1 };
+static int perf_leader = -1;
+
+static int
+perf_open(uint32_t type, uint64_t config, int group_fd)
+{
+	struct perf_event_attr pe;
+
+	memset(&pe, 0, sizeof(pe));
+	pe.size = sizeof(pe);
+	pe.type = type;
+	pe.config = config;
+	pe.disabled = group_fd < 0;
+	pe.exclude_kernel = 1;
+	pe.exclude_hv = 1;
+	pe.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+		PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(SYS_perf_event_open, &pe, 0, -1, group_fd, 0);
+}
+
+void
+perf_start(void)
+{
+	static const struct { uint32_t type; uint64_t config; } ev[] = {
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ PERF_TYPE_HW_CACHE, PERF_CACHE(PERF_COUNT_HW_CACHE_L1D,
+						 PERF_COUNT_HW_CACHE_RESULT_MISS) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+		{ PERF_TYPE_HW_CACHE, PERF_CACHE(PERF_COUNT_HW_CACHE_DTLB,
+						 PERF_COUNT_HW_CACHE_RESULT_MISS) },
+		{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	};
+	int cnt;
+
+	perf_events = 0;
+	for (cnt = 0; cnt < PERF_NEVENT; cnt++)
+		perf_count[cnt] = -1;
+	if (!use_perf)
+		return;
+	for (cnt = 0; cnt < PERF_NEVENT; cnt++) {
+		perf_fd[cnt] = perf_open(ev[cnt].type, ev[cnt].config,
+					 perf_leader);
+		if (perf_fd[cnt] < 0)
+			continue;
+		if (perf_leader < 0)
+			perf_leader = perf_fd[cnt];
+		perf_events++;
+	}
+	if (perf_leader < 0)
+		return;
+	ioctl(perf_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perf_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void
+perf_stop(void)
+{
+	uint64_t buf[3 + 2 * PERF_NEVENT];
+	uint64_t id;
+	double   scale;
+	int      cnt, i;
+
+	if (perf_leader < 0)
+		return;
+	ioctl(perf_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	/* nr, time enabled, time running, then value and id per event */
+	if (read(perf_leader, buf, sizeof(buf)) >= 3 * 8 && buf[2]) {
+		scale = (double)buf[1] / buf[2];
+		for (cnt = 0; cnt < PERF_NEVENT; cnt++) {
+			if (perf_fd[cnt] < 0 ||
+			    ioctl(perf_fd[cnt], PERF_EVENT_IOC_ID, &id) < 0)
+				continue;
+			for (i = 0; i < (int)buf[0]; i++) {
+				if (buf[4 + 2 * i] == id)
+					perf_count[cnt] = buf[3 + 2 * i] * scale;
+			}
+		}
+	}
+	for (cnt = 0; cnt < PERF_NEVENT; cnt++) {
+		if (perf_fd[cnt] >= 0)
+			close(perf_fd[cnt]);
+		perf_fd[cnt] = -1;
+	}
+	perf_leader = -1;
+}
+#else
+void perf_start(void) {
+	int cnt;
+
+	for (cnt = 0; cnt < PERF_NEVENT; cnt++)
+		perf_count[cnt] = -1;
+}
+void perf_stop(void) {}
+#endif
+
+/* Per-lookup latency.
+ * With lat=1 search_bench() times every lookup of a second pass over
+ * the timed loop into a log-linear histogram: values below 2^LAT_SUB
+ * ns have a bucket each, above that each power of two is split into
+ * 2^LAT_SUB linear buckets, so any value is known within 1/2^LAT_SUB.
+ * Percentiles are reported as the highest value of their bucket. */
+#define LAT_SUB		5
+#define LAT_NBUCKET	((64 - LAT_SUB) << LAT_SUB)
+
+typedef struct {
+	uint64_t count[LAT_NBUCKET];
+	uint64_t n;
+	uint64_t max;
+} lat_hist_t;
+
+int        lat;
+lat_hist_t lat_hist;
+
+static int
+lat_bucket(uint64_t v)
+{
+	int e;
+
+	if (v < (1 << LAT_SUB))
+		return v;
+	e = 63 - __builtin_clzll(v) - LAT_SUB;
+	return ((e + 1) << LAT_SUB) + (int)((v >> e) - (1 << LAT_SUB));
+}
+
+/* highest value of bucket b */
+static uint64_t
+lat_bucket_max(int b)
+{
+	int e = (b >> LAT_SUB) - 1;
+
+	if (e < 0)
+		return b;
+	return ((uint64_t)((1 << LAT_SUB) + (b & ((1 << LAT_SUB) - 1)) + 1)
+		<< e) - 1;
+}
+
+void
+lat_record(lat_hist_t *h, uint64_t ns)
+{
+	h->count[lat_bucket(ns)]++;
+	h->n++;
+	if (ns > h->max)
+		h->max = ns;
+}
+
+/* q-th quantile, 0 < q <= 1 */
+uint64_t
+lat_percentile(lat_hist_t *h, double q)
+{
+	uint64_t rank, seen = 0;
+	int      b;
+
+	if (!h->n)
+		return 0;
+	rank = (uint64_t)ceil(q * h->n);
+	if (rank < 1)
+		rank = 1;
+	for (b = 0; b < LAT_NBUCKET; b++) {
+		seen += h->count[b];
+		if (seen >= rank)
+			break;
+	}
+	if (b == LAT_NBUCKET || lat_bucket_max(b) > h->max)
+		return h->max;
+	return lat_bucket_max(b);
+}
+
+/* Scan statistics.
+ * Built with -D SCAN_STATS, the region_t scans (search(), kcmp, kmemeq,
+ * prefilter, prefetch, keyidx, the parallel scan, search_group() and
+ * search_many()) count the records whose key they compare, the key
+ * bytes up to and including the first mismatch, the value bytes they
+ * step over, and bucket the offset of the first mismatch: bucket 0 is
+ * offset 0, bucket b offsets 2^(b-1) to 2^b - 1.  The prefilter counts
+ * the records of a batch up to the match.  search_many() counts each
+ * record it walks once, with its value, and the key bytes of every key
+ * it is compared with.  search_bench() keeps what its timed loop
+ * did as scan_*, the group= and batch= loops as scan_group_* and
+ * scan_batch_*.  The sorted, hashed, front-coded and compressed layouts
+ * report their own figures and are not counted.  Finding the mismatch
+ * costs a byte loop per record, so the times of such a build are not
+ * comparable to the default build, where SCAN_STAT() is empty. */
+#ifdef SCAN_STATS
+#define SCAN_NBUCKET	16
+
+typedef struct {
+	uint64_t lookups;
+	uint64_t records;
+	uint64_t key_bytes;
+	uint64_t val_skipped;
+	uint64_t mismatch[SCAN_NBUCKET];
+} scan_stats_t;
+
+scan_stats_t scan_live;		/* every scan */
+scan_stats_t scan_stats;	/* the timed loop of search_bench() */
+scan_stats_t scan_group;	/* the search_group() loop of group_bench() */
+scan_stats_t scan_batch;	/* the search_many() loop of batch_bench() */
+
+#ifdef MPPA
+#define SCAN_ADD(x, v)	((x) += (v))
+#else
+#define SCAN_ADD(x, v)	__atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+#endif
+
+/* Key bytes of one compare, return 1 for a match */
+static int
+scan_key(region_t *tuple, char *key, int cmpsz)
+{
+	int off, b;
+
+	for (off = 0; off < cmpsz && tuple->key[off] == key[off]; off++)
+		;
+	if (off == cmpsz) {
+		SCAN_ADD(scan_live.key_bytes, cmpsz);
+		return 1;
+	}
+	b = off ? 32 - __builtin_clz(off) : 0;
+	if (b >= SCAN_NBUCKET)
+		b = SCAN_NBUCKET - 1;
+	SCAN_ADD(scan_live.key_bytes, off + 1);
+	SCAN_ADD(scan_live.mismatch[b], 1);
+	return 0;
+}
+
+/* A record a scan steps over */
+static void
+scan_visit(region_t *tuple)
+{
+	SCAN_ADD(scan_live.records, 1);
+	SCAN_ADD(scan_live.val_skipped, tuple->val_sz);
+}
+
+static void
+scan_stat(region_t *tuple, char *key, int cmpsz)
+{
+	if (scan_key(tuple, key, cmpsz))
+		SCAN_ADD(scan_live.records, 1);
+	else
+		scan_visit(tuple);
+}
+
+/* The first n records of a prefilter batch */
+static void
+scan_stat_batch(region_t **cand, int n, char *key, int key_sz)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		scan_stat(cand[i], key, cand[i]->key_sz < (uint32_t)key_sz ?
+			  (int)cand[i]->key_sz : key_sz);
+}
+
+static void
+scan_begin(void)
+{
+	memset(&scan_live, 0, sizeof(scan_live));
+}
+
+static void
+scan_end(scan_stats_t *st, uint64_t lookups)
+{
+	*st = scan_live;
+	st->lookups = lookups;
+}
+
+void
+scan_print(const char *name, scan_stats_t *st)
+{
+	int b;
+
+	printf("%s_lookups=%llu\n%s_records=%llu\n%s_key_bytes=%llu\n"
+	       "%s_val_skipped=%llu\n",
+	       name, (unsigned long long)st->lookups,
+	       name, (unsigned long long)st->records,
+	       name, (unsigned long long)st->key_bytes,
+	       name, (unsigned long long)st->val_skipped);
+	for (b = 0; b < SCAN_NBUCKET; b++)
+		printf("%s_mismatch_%d=%llu\n", name, b,
+		       (unsigned long long)st->mismatch[b]);
+}
+
+#define SCAN_STAT(tuple, key, cmpsz)	scan_stat(tuple, key, cmpsz)
+#define SCAN_KEY(tuple, key, cmpsz)	scan_key(tuple, key, cmpsz)
+#define SCAN_VISIT(tuple)		scan_visit(tuple)
+#define SCAN_STAT_BATCH(cand, n, key, key_sz) \
+	scan_stat_batch(cand, n, key, key_sz)
+#else
+#define SCAN_STAT(tuple, key, cmpsz)
+#define SCAN_KEY(tuple, key, cmpsz)
+#define SCAN_VISIT(tuple)
+#define SCAN_STAT_BATCH(cand, n, key, key_sz)
+#endif
+
 void
 print_key(char *buf, int size)
 {
@@ -161,9 +932,88 @@ print_key(char *buf, int size)
   printf(" ");
 }
 
+/* Side index kinds, selected by the keyidx parameter */
+#define KEYIDX_NONE	0
+#define KEYIDX_PFX	1	/* offsets and key prefixes */
+#define KEYIDX_HASH	2	/* offsets, key prefixes and key hashes */
+
+int keyidx;
+
+/* FNV-1a */
+uint32_t
+key_hash(const char *key, int key_sz)
+{
+  uint32_t h = 2166136261u;
+  int      cnt;
+
+  for (cnt = 0; cnt < key_sz; cnt++) {
+    h = (h ^ (unsigned char)key[cnt]) * 16777619u;
+  }
+  return h;
+}
+
+/* Index the records of a block, key_sz is the searched key size and
+ * only bounds the walk like search() does.  kind tells which of the
+ * per-record arrays are filled besides the offsets. */
+void
+build_recidx(recidx_t *ri, char *buf, int size, int key_sz, int kind)
+{
+	region_t *tuple;
+	char     *curr;
+	int      max, cnt;
+
+	max = size / 8 + 1;
+	ri->off = malloc(max * sizeof(*ri->off));
+	assert(ri->off);
+	ri->nrec = 0;
+	ri->min_ksz = UINT32_MAX;
+	ri->max_ksz = 0;
+	curr  = buf;
+	tuple = (region_t *)buf;
+	while ((curr + 8 + key_sz) < (buf + size)) {
+		assert(ri->nrec < max);
+		ri->off[ri->nrec++] = curr - buf;
+		if (tuple->key_sz < ri->min_ksz)
+			ri->min_ksz = tuple->key_sz;
+		if (tuple->key_sz > ri->max_ksz)
+			ri->max_ksz = tuple->key_sz;
+		curr = tuple->key + tuple->key_sz + tuple->val_sz;
+		tuple = (region_t *)curr;
+	}
+
+	ri->pfx = NULL;
+	ri->hash = NULL;
+	if (kind >= KEYIDX_PFX) {
+		ri->pfx = calloc(ri->nrec + 1, sizeof(*ri->pfx));
+		assert(ri->pfx);
+	}
+	if (kind >= KEYIDX_HASH) {
+		ri->hash = malloc((ri->nrec + 1) * sizeof(*ri->hash));
+		assert(ri->hash);
+	}
+	for (cnt = 0; cnt < ri->nrec && ri->pfx; cnt++) {
+		tuple = (region_t *)(buf + ri->off[cnt]);
+		memcpy(&ri->pfx[cnt], tuple->key,
+		       tuple->key_sz < 8 ? tuple->key_sz : 8);
+		if (ri->hash)
+			ri->hash[cnt] = key_hash(tuple->key, tuple->key_sz);
+	}
+}
+
+/* Number of indexed records search() would visit for a key of key_sz */
+int
+recidx_limit(recidx_t *ri, int size, int key_sz)
+{
+	int lim = ri->nrec;
+
+	while (lim > 0 && (int64_t)ri->off[lim - 1] + 8 + key_sz >= size)
+		lim--;
+	return lim;
+}
+
 void
 make_buf(char *buf, int size, char *target_key, int key_sz, int val_sz,
-	 int *bycmp)
+	 int *bycmp, recidx_t *ri)
 {
   char     *smallkey;
   region_t *tuple, *last;
@@ -198,66 +1048,4288 @@ make_buf(char *buf, int size, char *target_key, int key_sz, int val_sz,
   }
   memcpy(last->key, target_key, key_sz);
   free(smallkey);
+  if (ri) {
+    build_recidx(ri, buf, size, key_sz, keyidx);
+  }
 }
 
-region_t *
-search(char *buf,  int size, char *key, int key_sz)
+/* Workload generator.
+ * The classic workload is the block of make_buf(), with one target key.
+ * The other ones draw key and value sizes from a fixed, uniform, Zipf
+ * or lognormal distribution and look up `lookups' keys, hit% of them
+ * in the block at the records given by pos.  Keys start with a common
+ * prefix of `prefix' bytes followed by a 4 byte big endian tag, the
+ * record number for block keys and a larger number for missing keys,
+ * so no key is a prefix of another one.  Everything is drawn from a
+ * seeded generator, the same spec always gives the same block and keys,
+ * and on x86 the result can be kept in a cache directory. */
+#define WL_CLASSIC	0
+#define WL_FIXED	1
+#define WL_UNIFORM	2
+#define WL_ZIPF		3
+#define WL_LOGNORMAL	4
+
+#define WL_POS_LAST	0
+#define WL_POS_FIRST	1
+#define WL_POS_MIDDLE	2
+#define WL_POS_RANDOM	3
+
+#define WL_TAG_SZ	4
+#define WL_MAGIC	0x444c5753	/* "SWLD" */
+#define WL_VERSION	2
+
+const char *wl_dist_names[] = {
+	"classic", "fixed", "uniform", "zipf", "lognormal", NULL
+};
+const char *wl_pos_names[] = { "last", "first", "middle", "random", NULL };
+
+typedef struct {
+	/* the spec */
+	int   size;             /* block size */
+	int   key_sz;           /* smallest or median key size */
+	int   val_sz;           /* smallest or median value size */
+	int   kdist, vdist;     /* WL_* size distributions */
+	int   kmax, vmax;       /* largest sizes, 0 for 4 times the base */
+	int   zipf;             /* Zipf exponent in 1/100 */
+	int   sigma;            /* lognormal sigma in 1/100 */
+	int   prefix;           /* bytes shared by all keys */
+	int   hit;              /* percent of the lookups found */
+	int   pos;              /* WL_POS_* of the found records */
+	int   nlookup;
+	int   seed;
+	char *cache;            /* directory of generated workloads */
+	/* the lookups */
+	char **keys;
+	int   *key_len;
+	char  *found;           /* key is in the block */
+	int    min_len;         /* smallest lookup key */
+	int    nrec;            /* records in the block */
+} workload_t;
+
+workload_t wl = {
+	.kdist = WL_CLASSIC, .vdist = WL_FIXED, .zipf = 99, .sigma = 50,
+	.hit = 100, .pos = WL_POS_LAST, .nlookup = 64, .seed = 1
+};
+
+static uint64_t wl_state;
+
+/* splitmix64 */
+static uint64_t
+wl_rand(void)
 {
-  region_t *tuple;
-  char     *curr;
-  int      found = 0;
-  int      cmpsz;
+	uint64_t z = (wl_state += 0x9e3779b97f4a7c15ULL);
 
-  curr  = buf;
-  tuple = (region_t *)buf;
-  assert( (curr + 8) == tuple->key);
-  while ((curr + 8 + key_sz) < (buf + size)) {
-    cmpsz = key_sz;
-    if (tuple->key_sz < cmpsz) {
-      cmpsz = tuple->key_sz;
-    }
-#ifdef MPPA
-#define memcmp kmemcmp
-#endif
-    if (memcmp(tuple->key, key, cmpsz) == 0) {
-      found = 1;
-      break;
-    }
-#undef memcmp
-    curr = tuple->key;
-    curr = curr + tuple->key_sz + tuple->val_sz;
-    tuple = (region_t *)curr;
-  }
-  if (!found) {
-    tuple = 0;
-  }
-  return tuple;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
 }
 
-void
-search_bench (char *buf, int size, int rep, char *key, int key_sz,
-	      int val_sz, double *usec, int *bycmp)
+static double
+wl_unif(void)
 {
-	perf_t   bm;
-	char     *ptr, *tmp;
-	region_t *r;
+	return (wl_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
 
-	init_timer(&bm);
-	ptr = malloc(size + 8 + key_sz + val_sz);
-	if(!ptr){
-		printf("Out of mem!\n");
-		exit(1);
-	}
-	make_buf(ptr, size, key, key_sz, val_sz, bycmp);
-	fix_cache(ptr, size, *bycmp, 256*1024*1024);
-	start_timer(&bm);
-	while(rep--) {
-		tmp = kill_cache(ptr);
-		r = search(tmp, size, key, key_sz);
-		assert(r || 1);
+static void
+wl_fill(char *p, int len)
+{
+	uint64_t r;
+	int      cnt;
+
+	for (cnt = 0; cnt < len; cnt += 8) {
+		r = wl_rand();
+		memcpy(p + cnt, &r, len - cnt < 8 ? len - cnt : 8);
 	}
-	stop_timer(&bm);
-	*usec = usec_timer(&bm);
+}
+
+/* Size distribution over [lo, hi] */
+typedef struct {
+	int     dist, lo, hi, base;
+	double  sigma;
+	double *cdf;            /* Zipf only, rank r is size lo + r */
+} wl_size_t;
+
+static void
+wl_size_init(wl_size_t *sd, int dist, int base, int lo, int hi)
+{
+	double sum;
+	int    r;
+
+	sd->dist = dist;
+	sd->base = base;
+	sd->lo = lo;
+	sd->hi = hi;
+	sd->sigma = wl.sigma / 100.0;
+	sd->cdf = NULL;
+	if (dist != WL_ZIPF)
+		return;
+	sd->cdf = malloc((hi - lo + 1) * sizeof(*sd->cdf));
+	assert(sd->cdf);
+	sum = 0;
+	for (r = 0; r <= hi - lo; r++) {
+		sum += 1.0 / pow(r + 1, wl.zipf / 100.0);
+		sd->cdf[r] = sum;
+	}
+	for (r = 0; r <= hi - lo; r++)
+		sd->cdf[r] /= sum;
+}
+
+static int
+wl_size(wl_size_t *sd)
+{
+	double u, x;
+	int    l, h, m;
+
+	switch (sd->dist) {
+	case WL_UNIFORM:
+		return sd->lo + wl_rand() % (sd->hi - sd->lo + 1);
+	case WL_ZIPF:
+		u = wl_unif();
+		l = 0;
+		h = sd->hi - sd->lo;
+		while (l < h) {
+			m = (l + h) / 2;
+			if (sd->cdf[m] < u)
+				l = m + 1;
+			else
+				h = m;
+		}
+		return sd->lo + l;
+	case WL_LOGNORMAL:
+		/* Box-Muller */
+		u = wl_unif();
+		x = sqrt(-2 * log(1 - u)) * cos(2 * M_PI * wl_unif());
+		x = sd->base * exp(sd->sigma * x);
+		if (x < sd->lo)
+			return sd->lo;
+		if (x > sd->hi)
+			return sd->hi;
+		return (int)x;
+	}
+	return sd->base;
+}
+
+/* Check the spec and set the derived sizes, the classic workload looks
+ * up target */
+void
+wl_init(workload_t *w, char *target)
+{
+	if (w->kdist == WL_CLASSIC) {
+		w->kmax = w->key_sz;
+		w->vmax = w->val_sz;
+		w->nlookup = 1;
+		w->keys = malloc(sizeof(*w->keys));
+		w->key_len = malloc(sizeof(*w->key_len));
+		w->found = malloc(1);
+		assert(w->keys && w->key_len && w->found);
+		w->keys[0] = target;
+		w->key_len[0] = w->min_len = w->key_sz;
+		w->found[0] = 1;
+		return;
+	}
+	if (w->prefix < 0)
+		w->prefix = 0;
+	if (w->key_sz < w->prefix + WL_TAG_SZ)
+		w->key_sz = w->prefix + WL_TAG_SZ;
+	if (w->kmax <= 0)
+		w->kmax = w->kdist == WL_FIXED ? w->key_sz : 4 * w->key_sz;
+	if (w->kmax < w->key_sz)
+		w->kmax = w->key_sz;
+	if (w->vmax <= 0)
+		w->vmax = w->vdist == WL_FIXED ? w->val_sz : 4 * w->val_sz;
+	if (w->vmax < w->val_sz)
+		w->vmax = w->val_sz;
+	if (w->nlookup < 1)
+		w->nlookup = 1;
+	if (w->size < 2 * (8 + w->kmax) + 1) {
+		printf("block size %d too small for keys of %d bytes\n",
+		       w->size, w->kmax);
+		exit(1);
+	}
+}
+
+static void
+wl_key(workload_t *w, char *key, int len, uint32_t tag, char *pfx)
+{
+	memcpy(key, pfx, w->prefix);
+	key[w->prefix] = tag >> 24;
+	key[w->prefix + 1] = tag >> 16;
+	key[w->prefix + 2] = tag >> 8;
+	key[w->prefix + 3] = tag;
+	wl_fill(key + w->prefix + WL_TAG_SZ, len - w->prefix - WL_TAG_SZ);
+}
+
+/* Generate the block in buf, which has room for size + 8 + kmax + vmax
+ * bytes, and the lookups.  bycmp gets the key bytes of the block. */
+static void
+wl_generate(workload_t *w, char *buf, int *bycmp)
+{
+	wl_size_t ks, vs;
+	region_t  *tuple;
+	uint32_t  *off;
+	char      *curr, *end = buf + w->size, *pfx;
+	int       k, v, max, rec, cnt, last;
+
+	wl_state = w->seed;
+	/* key_sz and val_sz are the smallest sizes, but the median of a
+	 * lognormal, which is only clamped to the real floor */
+	wl_size_init(&ks, w->kdist, w->key_sz, w->kdist == WL_LOGNORMAL ?
+		     w->prefix + WL_TAG_SZ : w->key_sz, w->kmax);
+	wl_size_init(&vs, w->vdist, w->val_sz, w->vdist == WL_LOGNORMAL ?
+		     0 : w->val_sz, w->vmax);
+	pfx = malloc(w->prefix + 1);
+	assert(pfx);
+	wl_fill(pfx, w->prefix);
+
+	max = w->size / (8 + ks.lo) + 1;
+	off = malloc(max * sizeof(*off));
+	assert(off);
+	*bycmp = 0;
+	w->nrec = 0;
+	curr = buf;
+	for (;;) {
+		tuple = (region_t *)curr;
+		k = wl_size(&ks);
+		v = wl_size(&vs);
+		/* the last record keeps its key and takes what is left as
+		 * its value, so that search() never reads past it whatever
+		 * the key size.  There is always room for the largest key. */
+		last = curr + 8 + k + v + 8 + ks.hi + 1 > end;
+		if (last)
+			v = end - curr - 9 - k;
+		tuple->key_sz = k;
+		tuple->val_sz = v;
+		assert(w->nrec < max);
+		off[w->nrec] = curr - buf;
+		wl_key(w, tuple->key, k, w->nrec, pfx);
+		wl_fill(tuple->key + k, v);
+		*bycmp += k;
+		w->nrec++;
+		if (last)
+			break;
+		curr = tuple->key + k + v;
+	}
+
+	w->keys = malloc(w->nlookup * sizeof(*w->keys));
+	w->key_len = malloc(w->nlookup * sizeof(*w->key_len));
+	w->found = malloc(w->nlookup);
+	assert(w->keys && w->key_len && w->found);
+	w->min_len = INT32_MAX;
+	for (cnt = 0; cnt < w->nlookup; cnt++) {
+		w->found[cnt] = wl_rand() % 100 < (uint64_t)w->hit;
+		if (w->found[cnt]) {
+			switch (w->pos) {
+			case WL_POS_FIRST:
+				rec = 0;
+				break;
+			case WL_POS_MIDDLE:
+				rec = w->nrec / 2;
+				break;
+			case WL_POS_RANDOM:
+				rec = wl_rand() % w->nrec;
+				break;
+			default:
+				rec = w->nrec - 1;
+			}
+			tuple = (region_t *)(buf + off[rec]);
+			w->key_len[cnt] = tuple->key_sz;
+			w->keys[cnt] = malloc(tuple->key_sz);
+			assert(w->keys[cnt]);
+			memcpy(w->keys[cnt], tuple->key, tuple->key_sz);
+		} else {
+			k = wl_size(&ks);
+			w->key_len[cnt] = k;
+			w->keys[cnt] = malloc(k);
+			assert(w->keys[cnt]);
+			wl_key(w, w->keys[cnt], k, w->nrec + cnt, pfx);
+		}
+		if (w->key_len[cnt] < w->min_len)
+			w->min_len = w->key_len[cnt];
+	}
+	free(ks.cdf);
+	free(vs.cdf);
+	free(off);
+	free(pfx);
+}
+
+/* Header of a cached workload, followed by the block and the lookups,
+ * each as its length, found flag and key */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t spec;          /* wl_spec_hash() */
+	int32_t  size;
+	int32_t  nrec;
+	int32_t  nlookup;
+	int32_t  bycmp;
+} wl_hdr_t;
+
+static uint64_t
+wl_spec_hash(workload_t *w)
+{
+	int      spec[] = {
+		w->size, w->key_sz, w->val_sz, w->kdist, w->vdist, w->kmax,
+		w->vmax, w->zipf, w->sigma, w->prefix, w->hit, w->pos,
+		w->nlookup, w->seed
+	};
+	uint64_t h = WL_VERSION;
+	unsigned cnt;
+
+	for (cnt = 0; cnt < sizeof(spec) / sizeof(spec[0]); cnt++) {
+		h = (h ^ (uint32_t)spec[cnt]) * 0x100000001b3ULL;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+static int
+wl_load(workload_t *w, const char *path, char *buf, int *bycmp)
+{
+	wl_hdr_t hdr;
+	FILE     *f;
+	int      ok, cnt;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return 0;
+	ok = fread(&hdr, sizeof(hdr), 1, f) == 1 && hdr.magic == WL_MAGIC &&
+		hdr.version == WL_VERSION && hdr.spec == wl_spec_hash(w) &&
+		hdr.size == w->size && hdr.nlookup == w->nlookup &&
+		fread(buf, w->size, 1, f) == 1;
+	if (ok) {
+		w->nrec = hdr.nrec;
+		*bycmp = hdr.bycmp;
+		w->keys = calloc(w->nlookup, sizeof(*w->keys));
+		w->key_len = malloc(w->nlookup * sizeof(*w->key_len));
+		w->found = malloc(w->nlookup);
+		assert(w->keys && w->key_len && w->found);
+		w->min_len = INT32_MAX;
+	}
+	for (cnt = 0; ok && cnt < w->nlookup; cnt++) {
+		ok = fread(&w->key_len[cnt], sizeof(int), 1, f) == 1 &&
+			fread(&w->found[cnt], 1, 1, f) == 1 &&
+			w->key_len[cnt] > 0 && w->key_len[cnt] <= w->size;
+		if (!ok)
+			break;
+		w->keys[cnt] = malloc(w->key_len[cnt]);
+		assert(w->keys[cnt]);
+		ok = fread(w->keys[cnt], w->key_len[cnt], 1, f) == 1;
+		if (w->key_len[cnt] < w->min_len)
+			w->min_len = w->key_len[cnt];
+	}
+	fclose(f);
+	return ok;
+}
+
+static void
+wl_save(workload_t *w, const char *path, char *buf, int bycmp)
+{
+	wl_hdr_t hdr;
+	FILE     *f;
+	int      ok, cnt;
+
+	f = fopen(path, "wb");
+	if (!f) {
+		perror(path);
+		return;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = WL_MAGIC;
+	hdr.version = WL_VERSION;
+	hdr.spec = wl_spec_hash(w);
+	hdr.size = w->size;
+	hdr.nrec = w->nrec;
+	hdr.nlookup = w->nlookup;
+	hdr.bycmp = bycmp;
+	ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1 &&
+		fwrite(buf, w->size, 1, f) == 1;
+	for (cnt = 0; ok && cnt < w->nlookup; cnt++) {
+		ok = fwrite(&w->key_len[cnt], sizeof(int), 1, f) == 1 &&
+			fwrite(&w->found[cnt], 1, 1, f) == 1 &&
+			fwrite(w->keys[cnt], w->key_len[cnt], 1, f) == 1;
+	}
+	if (fclose(f) != 0 || !ok) {
+		perror(path);
+		remove(path);
+	}
+}
+
+/* Build the block of a generated workload in buf, from the cache
+ * directory when it has it */
+int wl_cached;
+
+void
+wl_make(workload_t *w, char *buf, int *bycmp)
+{
+	char path[4096];
+	int  cnt;
+
+	wl_cached = 0;
+	if (w->cache) {
+		snprintf(path, sizeof(path), "%s/wl-%016llx.bin", w->cache,
+			 (unsigned long long)wl_spec_hash(w));
+		if (wl_load(w, path, buf, bycmp)) {
+			wl_cached = 1;
+			return;
+		}
+		if (w->keys) {
+			for (cnt = 0; cnt < w->nlookup; cnt++)
+				free(w->keys[cnt]);
+			free(w->keys);
+			free(w->key_len);
+			free(w->found);
+		}
+	}
+	wl_generate(w, buf, bycmp);
+	if (w->cache)
+		wl_save(w, path, buf, *bycmp);
+}
+
+/* First-bytes prefilter scan.
+ * Record headers are walked PF_BATCH at a time, the first pfwidth (8,
+ * 16 or 32) bytes of the collected keys are compared against the
+ * searched key by a vector kernel, one 8-byte word of all the keys per
+ * call, and the full compare only runs for the records whose prefix
+ * matched.  On x86 the kernel is picked at load time by an ifunc
+ * resolver (SSE4.2, AVX2 or AVX-512), the MPPA build uses the generic
+ * one. */
+#define PF_BATCH 8
+#define PF_MAXWIDTH 32
+
+/* pfwidth=8, 16 or 32, any other value is refused */
+const char *pfwidth_names[] = { "8", "16", "32", NULL };
+int prefilter;
+int pfwidth;            /* index in pfwidth_names, 8 << pfwidth bytes */
+
+/* Return the bitmap of the PF_BATCH keys whose first 8 bytes, masked
+ * by mask, equal pfx */
+static unsigned
+pf_match_generic(char **keys, uint64_t pfx, uint64_t mask)
+{
+  unsigned hits = 0;
+  uint64_t v;
+  int      i;
+
+  for (i = 0; i < PF_BATCH; i++) {
+    memcpy(&v, keys[i], sizeof(v));
+    hits |= (((v & mask) == pfx) << i);
+  }
+  return hits;
+}
+
+#if defined(__x86_64__) && !defined(MPPA)
+#include <immintrin.h>
+
+__attribute__((target("sse4.2"))) static unsigned
+pf_match_sse42(char **keys, uint64_t pfx, uint64_t mask)
+{
+  __m128i  p = _mm_set1_epi64x(pfx);
+  __m128i  m = _mm_set1_epi64x(mask);
+  __m128i  v;
+  unsigned hits = 0;
+  int      i;
+
+  for (i = 0; i < PF_BATCH; i += 2) {
+    v = _mm_set_epi64x(*(int64_t *)keys[i + 1], *(int64_t *)keys[i]);
+    v = _mm_cmpeq_epi64(_mm_and_si128(v, m), p);
+    hits |= _mm_movemask_pd(_mm_castsi128_pd(v)) << i;
+  }
+  return hits;
+}
+
+__attribute__((target("avx2"))) static unsigned
+pf_match_avx2(char **keys, uint64_t pfx, uint64_t mask)
+{
+  __m256i  p = _mm256_set1_epi64x(pfx);
+  __m256i  m = _mm256_set1_epi64x(mask);
+  __m256i  v;
+  unsigned hits = 0;
+  int      i;
+
+  for (i = 0; i < PF_BATCH; i += 4) {
+    v = _mm256_loadu_si256((__m256i *)&keys[i]);
+    v = _mm256_i64gather_epi64((const long long *)0, v, 1);
+    v = _mm256_cmpeq_epi64(_mm256_and_si256(v, m), p);
+    hits |= _mm256_movemask_pd(_mm256_castsi256_pd(v)) << i;
+  }
+  return hits;
+}
+
+__attribute__((target("avx512f"))) static unsigned
+pf_match_avx512(char **keys, uint64_t pfx, uint64_t mask)
+{
+  __m512i v;
+
+  v = _mm512_loadu_si512(keys);
+  v = _mm512_i64gather_epi64(v, (const void *)0, 1);
+  return _mm512_cmpeq_epi64_mask(_mm512_and_si512(v, _mm512_set1_epi64(mask)),
+				 _mm512_set1_epi64(pfx));
+}
+
+/* 0 generic, 1 sse4.2, 2 avx2, 3 avx512 */
+static int
+pf_level(void)
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return 3;
+  if (__builtin_cpu_supports("avx2"))
+    return 2;
+  if (__builtin_cpu_supports("sse4.2"))
+    return 1;
+  return 0;
+}
+
+static unsigned (*resolve_pf_match(void))(char **, uint64_t, uint64_t)
+{
+  switch (pf_level()) {
+  case 3:
+    return pf_match_avx512;
+  case 2:
+    return pf_match_avx2;
+  case 1:
+    return pf_match_sse42;
+  }
+  return pf_match_generic;
+}
+
+unsigned pf_match(char **keys, uint64_t pfx, uint64_t mask)
+  __attribute__((ifunc("resolve_pf_match")));
+
+const char *
+pf_kernel_name(void)
+{
+  static const char *names[] = { "generic", "sse4.2", "avx2", "avx512" };
+
+  return names[pf_level()];
+}
+#else
+#define pf_match pf_match_generic
+
+const char *
+pf_kernel_name(void)
+{
+  return "generic";
+}
+#endif
+
+region_t *
+search_prefilter(char *buf, int size, char *key, int key_sz)
+{
+  region_t *tuple, *cand[PF_BATCH];
+  char     *keys[PF_BATCH], *wkeys[PF_BATCH];
+  char     *curr;
+  uint64_t pfx[PF_MAXWIDTH / 8], mask[PF_MAXWIDTH / 8];
+  unsigned hits;
+  int      width, pfx_sz, cmpsz, nword, n, i, w;
+
+  width = 8 << pfwidth;
+  pfx_sz = key_sz < width ? key_sz : width;
+  nword = (pfx_sz + 7) / 8;
+  memset(pfx, 0, sizeof(pfx));
+  memcpy(pfx, key, pfx_sz);
+  for (w = 0; w < nword; w++) {
+    mask[w] = pfx_sz >= 8 * (w + 1) ? ~(uint64_t)0 :
+      (((uint64_t)1 << (8 * (pfx_sz - 8 * w))) - 1);
+  }
+
+  curr  = buf;
+  assert( (curr + 8) == ((region_t *)curr)->key);
+  while ((curr + 8 + key_sz) < (buf + size)) {
+    for (n = 0; n < PF_BATCH && (curr + 8 + key_sz) < (buf + size); n++) {
+      tuple = (region_t *)curr;
+      cand[n] = tuple;
+      /* keys shorter than the prefix always go to the full compare */
+      keys[n] = tuple->key_sz < (uint32_t)pfx_sz ? (char *)pfx : tuple->key;
+      curr = tuple->key + tuple->key_sz + tuple->val_sz;
+    }
+    for (i = n; i < PF_BATCH; i++) {
+      keys[i] = (char *)pfx;
+    }
+    hits = pf_match(keys, pfx[0], mask[0]) & ((1u << n) - 1);
+    for (w = 1; w < nword && hits; w++) {
+      for (i = 0; i < PF_BATCH; i++) {
+	wkeys[i] = keys[i] + 8 * w;
+      }
+      hits &= pf_match(wkeys, pfx[w], mask[w]);
+    }
+    while (hits) {
+      i = __builtin_ctz(hits);
+      hits &= hits - 1;
+      cmpsz = key_sz;
+      if (cand[i]->key_sz < cmpsz) {
+	cmpsz = cand[i]->key_sz;
+      }
+#ifdef MPPA
+#define memcmp kmemcmp
+#endif
+      if (memcmp(cand[i]->key, key, cmpsz) == 0) {
+	SCAN_STAT_BATCH(cand, i + 1, key, key_sz);
+	return cand[i];
+      }
+#undef memcmp
+    }
+    SCAN_STAT_BATCH(cand, n, key, key_sz);
+  }
+  return 0;
+}
+
+/* Software-prefetch pipelined scan.
+ * A lead cursor decodes the record headers `prefetch' records ahead of
+ * the compare and prefetches the header and key lines of the record
+ * after it, so the misses of the coming records are in flight while a
+ * key is compared.  search_group() walks several blocks in lock step,
+ * one record of each per round, so that the misses of the independent
+ * blocks overlap. */
+#define PREFETCH_MAX	64	/* records decoded ahead */
+#define PREFETCH_LINES	4	/* cache lines of a record prefetched */
+#define GROUP_MAX	16
+
+int prefetch;		/* distance in records, 0 for the plain scan */
+int group;		/* blocks searched together by search_group() */
+
+static inline void
+prefetch_rec(char *curr, int key_sz)
+{
+  int off;
+
+  for (off = 0; off < 8 + key_sz && off < PREFETCH_LINES * 64; off += 64) {
+    __builtin_prefetch(curr + off);
+  }
+}
+
+region_t *
+search_prefetch(char *buf, int size, char *key, int key_sz)
+{
+  region_t *ring[PREFETCH_MAX];
+  region_t *tuple;
+  char     *lead;
+  int      dist, head, n, cmpsz;
+
+  dist = prefetch < PREFETCH_MAX ? prefetch : PREFETCH_MAX;
+  lead = buf;
+  assert( (lead + 8) == ((region_t *)lead)->key);
+  for (n = 0; n < dist && (lead + 8 + key_sz) < (buf + size); n++) {
+    tuple = (region_t *)lead;
+    ring[n] = tuple;
+    lead = tuple->key + tuple->key_sz + tuple->val_sz;
+    prefetch_rec(lead, key_sz);
+  }
+  /* ring[head] is the oldest record, the n records after it (modulo
+   * dist) are in file order */
+  head = 0;
+  while (n) {
+    tuple = ring[head];
+    if ((lead + 8 + key_sz) < (buf + size)) {
+      ring[head] = (region_t *)lead;
+      lead = ((region_t *)lead)->key + ((region_t *)lead)->key_sz +
+	((region_t *)lead)->val_sz;
+      prefetch_rec(lead, key_sz);
+    } else {
+      n--;
+    }
+    head = head + 1 == dist ? 0 : head + 1;
+    cmpsz = key_sz;
+    if (tuple->key_sz < cmpsz) {
+      cmpsz = tuple->key_sz;
+    }
+    SCAN_STAT(tuple, key, cmpsz);
+#ifdef MPPA
+#define memcmp kmemcmp
+#endif
+    if (memcmp(tuple->key, key, cmpsz) == 0) {
+      return tuple;
+    }
+#undef memcmp
+  }
+  return 0;
+}
+
+/* Search the same key in nblk blocks of the same size, res[i] gets the
+ * result of search(bufs[i], ...) */
+void
+search_group(char **bufs, int nblk, int size, char *key, int key_sz,
+	     region_t **res)
+{
+  char     *curr[GROUP_MAX];
+  region_t *tuple;
+  char     *next;
+  int      live[GROUP_MAX];
+  int      nlive, cmpsz, i, g;
+
+  assert(nblk <= GROUP_MAX);
+  for (g = 0; g < nblk; g++) {
+    curr[g] = bufs[g];
+    live[g] = g;
+    res[g] = 0;
+  }
+  nlive = nblk;
+  while (nlive) {
+    for (i = 0; i < nlive; i++) {
+      g = live[i];
+      if ((curr[g] + 8 + key_sz) >= (bufs[g] + size)) {
+	live[i--] = live[--nlive];
+	continue;
+      }
+      tuple = (region_t *)curr[g];
+      next = tuple->key + tuple->key_sz + tuple->val_sz;
+      prefetch_rec(next, key_sz);
+      cmpsz = key_sz;
+      if (tuple->key_sz < cmpsz) {
+	cmpsz = tuple->key_sz;
+      }
+      SCAN_STAT(tuple, key, cmpsz);
+#ifdef MPPA
+#define memcmp kmemcmp
+#endif
+      if (memcmp(tuple->key, key, cmpsz) == 0) {
+	res[g] = tuple;
+	live[i--] = live[--nlive];
+	continue;
+      }
+#undef memcmp
+      curr[g] = next;
+    }
+  }
+}
+
+/* Equality kernels specialized by key size.
+ * With kmemeq=1 search() dispatches once per block, on the searched key
+ * size, to a scan whose key compare is the kmemeq_N() of kmemcmp.h for
+ * that size, inlined and unrolled.  Other sizes use kmemeq().  Records
+ * with a key shorter than the searched one are compared on their key
+ * size, as search() does, with kmemeq(). */
+int use_kmemeq;
+
+static inline __attribute__((always_inline)) region_t *
+search_eq_scan(char *buf, int size, char *key, int key_sz,
+	       int (*eq)(const void *, const void *))
+{
+  region_t *tuple;
+  char     *curr;
+
+  curr  = buf;
+  while ((curr + 8 + key_sz) < (buf + size)) {
+    tuple = (region_t *)curr;
+    SCAN_STAT(tuple, key, tuple->key_sz < (uint32_t)key_sz ?
+	      (int)tuple->key_sz : key_sz);
+    /* eq() reads key_sz bytes, a shorter record key goes to kmemeq() */
+    if ((eq && tuple->key_sz >= (uint32_t)key_sz) ?
+	eq(tuple->key, key) :
+	kmemeq(tuple->key, key, tuple->key_sz < (uint32_t)key_sz ?
+	       tuple->key_sz : (uint32_t)key_sz)) {
+      return tuple;
+    }
+    curr = tuple->key + tuple->key_sz + tuple->val_sz;
+  }
+  return 0;
+}
+
+/* Key size of the kmemeq_N() search_kmemeq() uses, 0 for kmemeq() */
+int
+kmemeq_kernel(int key_sz)
+{
+  switch (key_sz) {
+  case 8: case 10: case 16: case 32: case 100:
+    return key_sz;
+  }
+  return 0;
+}
+
+region_t *
+search_kmemeq(char *buf, int size, char *key, int key_sz)
+{
+  switch (key_sz) {
+  case 8:
+    return search_eq_scan(buf, size, key, 8, kmemeq_8);
+  case 10:
+    return search_eq_scan(buf, size, key, 10, kmemeq_10);
+  case 16:
+    return search_eq_scan(buf, size, key, 16, kmemeq_16);
+  case 32:
+    return search_eq_scan(buf, size, key, 32, kmemeq_32);
+  case 100:
+    return search_eq_scan(buf, size, key, 100, kmemeq_100);
+  }
+  return search_eq_scan(buf, size, key, key_sz, NULL);
+}
+
+#ifndef MPPA
+/* Key compare of search().
+ * On x86 search() calls libc memcmp() directly unless the kcmp
+ * parameter picks one of the kmemcmp() variants of kmemcmp/kmemcmp.h,
+ * which search_kcmp() then calls through key_cmp.  kcmp=auto times the
+ * ones this CPU runs on keys of the benchmark size that differ in
+ * their last byte, as the keys of make_buf() do, and keeps the fastest;
+ * the pick can change from run to run, so it is printed as kcmp_pick.
+ * The MPPA build always uses kmemcmp(). */
+#define KCMP_AUTO	0
+#define KCMP_LIBC	1
+#define KCMP_NVAR	6
+#define KCMP_ROUNDS	3
+#define KCMP_CALLS	20000
+
+typedef int (*kcmp_fn_t)(const void *, const void *, size_t);
+
+const char *kcmp_names[] = {
+	"auto", "libc", "generic", "sse2", "avx2", "avx512", NULL
+};
+int       kcmp = KCMP_LIBC;
+int       kcmp_pick = KCMP_LIBC;	/* kernel used, the one auto chose */
+kcmp_fn_t key_cmp = memcmp;
+double    kcmp_ns[KCMP_NVAR];	/* ns per compare, -1 if not timed */
+
+/* Variant k, NULL if the CPU cannot run it */
+static kcmp_fn_t
+kcmp_fn(int k)
+{
+	__builtin_cpu_init();
+	switch (k) {
+	case 1:
+		return memcmp;
+	case 2:
+		return kmemcmp_generic;
+#if defined(__x86_64__)
+	case 3:
+		return __builtin_cpu_supports("sse2") ? kmemcmp_sse2 : NULL;
+	case 4:
+		return __builtin_cpu_supports("avx2") ? kmemcmp_avx2 : NULL;
+	case 5:
+		return __builtin_cpu_supports("avx512f") &&
+			__builtin_cpu_supports("avx512bw") ? kmemcmp_avx512 : NULL;
+#endif
+	}
+	return NULL;
+}
+
+void
+kcmp_init(int key_sz)
+{
+	kcmp_fn_t fn;
+	uint64_t  t0, t, best;
+	char      *a, *b;
+	int       k, r, cnt, pick, sink = 0;
+
+	for (k = 0; k < KCMP_NVAR; k++)
+		kcmp_ns[k] = -1;
+	if (kcmp != KCMP_AUTO) {
+		kcmp_pick = kcmp;
+		key_cmp = kcmp_fn(kcmp);
+		if (!key_cmp) {
+			printf("kcmp=%s does not run on this CPU\n",
+			       kcmp_names[kcmp]);
+			exit(1);
+		}
+		return;
+	}
+	a = malloc(key_sz + 1);
+	b = malloc(key_sz + 1);
+	assert(a && b);
+	memset(a, 0x5a, key_sz + 1);
+	memset(b, 0x5a, key_sz + 1);
+	if (key_sz > 0)
+		b[key_sz - 1] ^= 1;
+	pick = 1;
+	for (k = 1; k < KCMP_NVAR; k++) {
+		fn = kcmp_fn(k);
+		if (!fn)
+			continue;
+		best = UINT64_MAX;
+		for (r = 0; r < KCMP_ROUNDS; r++) {
+			t0 = lat_now_ns();
+			for (cnt = 0; cnt < KCMP_CALLS; cnt++) {
+				/* keep the compare in the loop */
+				__asm__ __volatile__("" : "+r" (a));
+				sink += fn(a, b, key_sz) != 0;
+			}
+			t = lat_now_ns() - t0;
+			if (t < best)
+				best = t;
+		}
+		assert(sink || key_sz == 0);
+		kcmp_ns[k] = (double)best / KCMP_CALLS;
+		if (kcmp_ns[k] < kcmp_ns[pick])
+			pick = k;
+	}
+	kcmp_pick = pick;
+	key_cmp = kcmp_fn(pick);
+	free(a);
+	free(b);
+}
+
+region_t *
+search_kcmp(char *buf, int size, char *key, int key_sz)
+{
+  region_t *tuple;
+  char     *curr;
+  int      cmpsz;
+
+  curr  = buf;
+  while ((curr + 8 + key_sz) < (buf + size)) {
+    tuple = (region_t *)curr;
+    cmpsz = key_sz;
+    if (tuple->key_sz < cmpsz) {
+      cmpsz = tuple->key_sz;
+    }
+    SCAN_STAT(tuple, key, cmpsz);
+    if (key_cmp(tuple->key, key, cmpsz) == 0) {
+      return tuple;
+    }
+    curr = tuple->key + tuple->key_sz + tuple->val_sz;
+  }
+  return 0;
+}
+#endif
+
+region_t *
+search(char *buf,  int size, char *key, int key_sz)
+{
+  region_t *tuple;
+  char     *curr;
+  int      found = 0;
+  int      cmpsz;
+
+  if (prefilter) {
+    return search_prefilter(buf, size, key, key_sz);
+  }
+  if (prefetch > 0) {
+    return search_prefetch(buf, size, key, key_sz);
+  }
+  if (use_kmemeq) {
+    return search_kmemeq(buf, size, key, key_sz);
+  }
+#ifndef MPPA
+  if (kcmp_pick != KCMP_LIBC) {
+    return search_kcmp(buf, size, key, key_sz);
+  }
+#endif
+  curr  = buf;
+  tuple = (region_t *)buf;
+  assert( (curr + 8) == tuple->key);
+  while ((curr + 8 + key_sz) < (buf + size)) {
+    cmpsz = key_sz;
+    if (tuple->key_sz < cmpsz) {
+      cmpsz = tuple->key_sz;
+    }
+    SCAN_STAT(tuple, key, cmpsz);
+#ifdef MPPA
+#define memcmp kmemcmp
+#endif
+    if (memcmp(tuple->key, key, cmpsz) == 0) {
+      found = 1;
+      break;
+    }
+#undef memcmp
+    curr = tuple->key;
+    curr = curr + tuple->key_sz + tuple->val_sz;
+    tuple = (region_t *)curr;
+  }
+  if (!found) {
+    tuple = 0;
+  }
+  return tuple;
+}
+
+typedef region_t *(*search_fn_t)(char *, int, char *, int);
+
+/* Index of the benchmark block, built by make_buf() */
+recidx_t blkidx;
+
+/* Side index scan.
+ * Runs over the dense prefix (and hash) arrays of blkidx, or of its
+ * copy that goes with the block copy kill_cache() handed out, and
+ * only touches the records of the block whose prefix and hash matched.
+ * The prefix is cut to the shortest key of the block so that keys
+ * shorter than the searched one still match on their own length;
+ * hashes cover whole keys and are only used when every key of the
+ * block has the searched size. */
+region_t *
+search_keyidx(char *buf, int size, char *key, int key_sz)
+{
+#ifndef MPPA
+  recidx_t *ri = cache_ri ? &cache_ri[cache_page] : &blkidx;
+#else
+  recidx_t *ri = &blkidx;
+#endif
+  region_t *tuple;
+  uint64_t pfx, mask;
+  uint32_t hash = 0;
+  int      pfx_sz, cmpsz, use_hash, nrec, cnt;
+
+  nrec = recidx_limit(ri, size, key_sz);
+  if (nrec == 0) {
+    return 0;
+  }
+  pfx_sz = key_sz;
+  if (ri->min_ksz < (uint32_t)pfx_sz) {
+    pfx_sz = ri->min_ksz;
+  }
+  if (pfx_sz > 8) {
+    pfx_sz = 8;
+  }
+  mask = pfx_sz == 8 ? ~(uint64_t)0 : (((uint64_t)1 << (8 * pfx_sz)) - 1);
+  pfx = 0;
+  memcpy(&pfx, key, pfx_sz);
+  use_hash = ri->hash && ri->min_ksz == ri->max_ksz &&
+    ri->min_ksz == (uint32_t)key_sz;
+  if (use_hash) {
+    hash = key_hash(key, key_sz);
+  }
+
+  for (cnt = 0; cnt < nrec; cnt++) {
+    if ((ri->pfx[cnt] & mask) != pfx) {
+      continue;
+    }
+    if (use_hash && ri->hash[cnt] != hash) {
+      continue;
+    }
+    tuple = (region_t *)(buf + ri->off[cnt]);
+    cmpsz = key_sz;
+    if (tuple->key_sz < cmpsz) {
+      cmpsz = tuple->key_sz;
+    }
+    SCAN_STAT(tuple, key, cmpsz);
+#ifdef MPPA
+#define memcmp kmemcmp
+#endif
+    if (memcmp(tuple->key, key, cmpsz) == 0) {
+      return tuple;
+    }
+#undef memcmp
+  }
+  return 0;
+}
+
+/* Per-block membership filters.
+ * A filter of the keys of a block is built with the block and checked
+ * before the scan, a key it rules out is a miss that does not touch
+ * the block.  Filters hash whole keys, so a block whose keys do not
+ * all have the searched size (search() then matches them on the
+ * shorter size) always goes to the scan. */
+#define FILTER_NONE	0
+#define FILTER_BLOOM	1
+#define FILTER_BLOCKED	2	/* Bloom filter per 512-bit block */
+#define FILTER_XOR	3	/* 8-bit fingerprints, 16-bit from 16 bpk */
+
+const char *filter_names[] = { "none", "bloom", "blocked", "xor", NULL };
+
+int filter;
+int filter_bpk = 10;
+
+typedef struct {
+	int       type;
+	uint32_t  key_sz;  /* size of every key, 0 if they differ */
+	uint64_t  nbits;   /* Bloom bits, or 512-bit blocks if blocked */
+	int       nhash;
+	uint64_t *bits;
+	uint64_t  seed;    /* xor: hash seed the keys peeled with */
+	uint32_t  seglen;  /* xor: fingerprints per hash segment */
+	int       fpbits;  /* xor: 8 or 16 */
+	void     *fp;      /* xor: 3 * seglen fingerprints */
+	uint64_t  bytes;   /* memory used by the filter */
+} blkfilter_t;
+
+blkfilter_t blkfilter;
+
+static inline uint64_t
+mix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+/* FNV-1a 64 finished by the murmur3 mixer */
+uint64_t
+key_hash64(const char *key, int key_sz)
+{
+	uint64_t h = 14695981039346656037ull;
+	int      cnt;
+
+	for (cnt = 0; cnt < key_sz; cnt++)
+		h = (h ^ (unsigned char)key[cnt]) * 1099511628211ull;
+	return mix64(h);
+}
+
+static inline uint32_t
+xor_slot(uint64_t h, int i, uint32_t seglen)
+{
+	uint64_t r = i ? (h << (21 * i)) | (h >> (64 - 21 * i)) : h;
+
+	return (uint32_t)(((uint64_t)(uint32_t)r * seglen) >> 32) + i * seglen;
+}
+
+static inline uint32_t
+xor_get(blkfilter_t *bf, uint32_t slot)
+{
+	if (bf->fpbits == 8)
+		return ((uint8_t *)bf->fp)[slot];
+	return ((uint16_t *)bf->fp)[slot];
+}
+
+static inline uint32_t
+xor_fp(blkfilter_t *bf, uint64_t h)
+{
+	return (uint32_t)(h ^ (h >> 32)) & ((1u << bf->fpbits) - 1);
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Build the xor filter of the n distinct hashes in h, 0 if they do not
+ * peel with bf->seed */
+static int
+xor_build(blkfilter_t *bf, uint64_t *base, int n)
+{
+	uint32_t size = 3 * bf->seglen;
+	uint64_t *xh, *peeled, h;
+	uint32_t *cnt, *queue, *at;
+	uint32_t slot, s, f;
+	int      head, tail, done, ok, i, j;
+
+	xh = calloc(size, sizeof(*xh));
+	cnt = calloc(size, sizeof(*cnt));
+	queue = malloc(size * sizeof(*queue));
+	peeled = malloc((n + 1) * sizeof(*peeled));
+	at = malloc((n + 1) * sizeof(*at));
+	assert(xh && cnt && queue && peeled && at);
+	for (i = 0; i < n; i++) {
+		h = mix64(base[i] + bf->seed);
+		for (j = 0; j < 3; j++) {
+			slot = xor_slot(h, j, bf->seglen);
+			xh[slot] ^= h;
+			cnt[slot]++;
+		}
+	}
+	head = tail = 0;
+	for (s = 0; s < size; s++)
+		if (cnt[s] == 1)
+			queue[tail++] = s;
+	done = 0;
+	while (head < tail) {
+		s = queue[head++];
+		if (cnt[s] != 1)
+			continue;
+		/* s holds a single hash, it is the xor of the slot */
+		h = xh[s];
+		peeled[done] = h;
+		at[done++] = s;
+		for (j = 0; j < 3; j++) {
+			slot = xor_slot(h, j, bf->seglen);
+			xh[slot] ^= h;
+			if (--cnt[slot] == 1)
+				queue[tail++] = slot;
+		}
+	}
+	ok = done == n;
+	if (ok) {
+		bf->fp = calloc(size, bf->fpbits / 8);
+		assert(bf->fp);
+		/* assign in reverse peeling order, the slot of each hash is
+		 * the last of its three to be set */
+		while (done--) {
+			h = peeled[done];
+			f = xor_fp(bf, h);
+			for (j = 0; j < 3; j++)
+				f ^= xor_get(bf, xor_slot(h, j, bf->seglen));
+			if (bf->fpbits == 8)
+				((uint8_t *)bf->fp)[at[done]] = f;
+			else
+				((uint16_t *)bf->fp)[at[done]] = f;
+		}
+	}
+	free(xh);
+	free(cnt);
+	free(queue);
+	free(peeled);
+	free(at);
+	return ok;
+}
+
+void
+build_filter(blkfilter_t *bf, char *buf, int size, int key_sz, int type,
+	     int bpk)
+{
+	recidx_t ri;
+	region_t *tuple;
+	uint64_t *h, pos, step;
+	int      n, cnt, i;
+
+	memset(bf, 0, sizeof(*bf));
+	bf->type = type;
+	build_recidx(&ri, buf, size, key_sz, KEYIDX_NONE);
+	h = malloc((ri.nrec + 1) * sizeof(*h));
+	assert(h);
+	for (cnt = 0; cnt < ri.nrec; cnt++) {
+		tuple = (region_t *)(buf + ri.off[cnt]);
+		h[cnt] = key_hash64(tuple->key, tuple->key_sz);
+	}
+	if (ri.nrec && ri.min_ksz == ri.max_ksz)
+		bf->key_sz = ri.min_ksz;
+	free(ri.off);
+
+	/* the filter holds distinct keys */
+	qsort(h, ri.nrec, sizeof(*h), cmp_u64);
+	for (n = 0, cnt = 0; cnt < ri.nrec; cnt++)
+		if (n == 0 || h[n - 1] != h[cnt])
+			h[n++] = h[cnt];
+
+	bf->nhash = (int)(bpk * 0.693 + 0.5);
+	if (bf->nhash < 1)
+		bf->nhash = 1;
+	if (bf->nhash > 16)
+		bf->nhash = 16;
+	switch (type) {
+	case FILTER_BLOOM:
+		bf->nbits = (uint64_t)n * bpk + 64;
+		bf->bits = calloc((bf->nbits + 63) / 64, 8);
+		assert(bf->bits);
+		bf->bytes = (bf->nbits + 63) / 64 * 8;
+		for (cnt = 0; cnt < n; cnt++) {
+			step = (h[cnt] >> 32) | 1;
+			for (i = 0, pos = h[cnt]; i < bf->nhash; i++, pos += step)
+				bf->bits[pos % bf->nbits / 64] |=
+					(uint64_t)1 << (pos % bf->nbits % 64);
+		}
+		break;
+	case FILTER_BLOCKED:
+		bf->nbits = ((uint64_t)n * bpk + 511) / 512;
+		bf->bits = calloc(bf->nbits * 8, 8);
+		assert(bf->bits);
+		bf->bytes = bf->nbits * 64;
+		for (cnt = 0; cnt < n; cnt++) {
+			uint64_t *blk = bf->bits +
+				8 * (((h[cnt] >> 32) * bf->nbits) >> 32);
+
+			pos = mix64(h[cnt]);
+			step = (pos >> 32) | 1;
+			for (i = 0; i < bf->nhash; i++, pos += step)
+				blk[(pos & 511) / 64] |= (uint64_t)1 << (pos & 63);
+		}
+		break;
+	case FILTER_XOR:
+		bf->fpbits = bpk >= 16 ? 16 : 8;
+		bf->seglen = (uint32_t)(1.23 * n / 3) + 11;
+		bf->bytes = (uint64_t)3 * bf->seglen * bf->fpbits / 8;
+		for (bf->seed = 0; !xor_build(bf, h, n); bf->seed++)
+			assert(bf->seed < 1000);
+		break;
+	}
+	free(h);
+}
+
+/* Return 0 if key is known not to be in the block */
+static inline int
+filter_may_contain(blkfilter_t *bf, char *key, int key_sz)
+{
+	uint64_t h, pos, step, *blk;
+	uint32_t f;
+	int      i;
+
+	if (!bf->key_sz || (uint32_t)key_sz != bf->key_sz)
+		return 1;
+	h = key_hash64(key, key_sz);
+	switch (bf->type) {
+	case FILTER_BLOOM:
+		step = (h >> 32) | 1;
+		for (i = 0, pos = h; i < bf->nhash; i++, pos += step)
+			if (!(bf->bits[pos % bf->nbits / 64] &
+			      ((uint64_t)1 << (pos % bf->nbits % 64))))
+				return 0;
+		return 1;
+	case FILTER_BLOCKED:
+		blk = bf->bits + 8 * (((h >> 32) * bf->nbits) >> 32);
+		pos = mix64(h);
+		step = (pos >> 32) | 1;
+		for (i = 0; i < bf->nhash; i++, pos += step)
+			if (!(blk[(pos & 511) / 64] & ((uint64_t)1 << (pos & 63))))
+				return 0;
+		return 1;
+	case FILTER_XOR:
+		h = mix64(h + bf->seed);
+		f = xor_fp(bf, h);
+		for (i = 0; i < 3; i++)
+			f ^= xor_get(bf, xor_slot(h, i, bf->seglen));
+		return f == 0;
+	}
+	return 1;
+}
+
+/* Search run behind the filter of the benchmark block */
+search_fn_t filtered_fn;
+
+region_t *
+search_filtered(char *buf, int size, char *key, int key_sz)
+{
+	if (!filter_may_contain(&blkfilter, key, key_sz))
+		return 0;
+	return filtered_fn(buf, size, key, key_sz);
+}
+
+/* Batched lookups.
+ * search_many() resolves a batch of keys in a single walk of the
+ * block.  Up to SEARCH_MANY_LINEAR keys every record is compared with
+ * each unresolved key; larger batches go through an open addressing
+ * table of the keys, hashed on their first and last 8 bytes so that a
+ * record costs one hash and usually a single memcmp.  The table
+ * already wins over the compares from two keys on x86.  Records shorter
+ * than the keys still match on their own length, like in search(), so
+ * they are compared with every key. */
+#define SEARCH_MANY_LINEAR 1
+
+int batch;
+
+static inline uint64_t
+sample_hash(const char *key, int key_sz)
+{
+	uint64_t a = 0, b = 0;
+
+	if (key_sz >= 8) {
+		memcpy(&a, key, 8);
+		memcpy(&b, key + key_sz - 8, 8);
+	} else {
+		memcpy(&a, key, key_sz);
+	}
+	return mix64(a ^ mix64(b ^ key_sz));
+}
+
+/* Look the nkeys keys up in one pass, res[i] gets the first record
+ * matching keys[i] or NULL.  Return the number of keys found. */
+int
+search_many(char *buf, int size, char **keys, int nkeys, int key_sz,
+	    region_t **res)
+{
+	region_t *tuple;
+	char     *curr;
+	uint64_t *hash = NULL, h;
+	int      *slot = NULL, *dup = NULL;
+	int      mask = 0, left, cmpsz, i, j;
+
+	for (i = 0; i < nkeys; i++) {
+		res[i] = 0;
+	}
+	if (nkeys > SEARCH_MANY_LINEAR) {
+		/* slot[] holds key numbers + 1, dup[] chains equal keys */
+		for (mask = 1; mask < 2 * nkeys; mask <<= 1)
+			;
+		slot = calloc(mask, sizeof(*slot));
+		hash = malloc(nkeys * sizeof(*hash));
+		dup = malloc(nkeys * sizeof(*dup));
+		assert(slot && hash && dup);
+		mask--;
+		for (i = 0; i < nkeys; i++) {
+			hash[i] = sample_hash(keys[i], key_sz);
+			dup[i] = -1;
+			for (j = hash[i] & mask; slot[j]; j = (j + 1) & mask) {
+				if (hash[slot[j] - 1] == hash[i] &&
+				    memcmp(keys[slot[j] - 1], keys[i], key_sz) == 0)
+					break;
+			}
+			if (slot[j]) {
+				dup[i] = dup[slot[j] - 1];
+				dup[slot[j] - 1] = i;
+			} else {
+				slot[j] = i + 1;
+			}
+		}
+	}
+
+	left  = nkeys;
+	curr  = buf;
+	tuple = (region_t *)buf;
+	while (left && (curr + 8 + key_sz) < (buf + size)) {
+		SCAN_VISIT(tuple);
+		cmpsz = key_sz;
+		if (tuple->key_sz < cmpsz) {
+			cmpsz = tuple->key_sz;
+		}
+#ifdef MPPA
+#define memcmp kmemcmp
+#endif
+		if (!slot || cmpsz < key_sz) {
+			for (i = 0; i < nkeys; i++) {
+				if (!res[i]) {
+					SCAN_KEY(tuple, keys[i], cmpsz);
+				}
+				if (!res[i] && memcmp(tuple->key, keys[i], cmpsz) == 0) {
+					res[i] = tuple;
+					left--;
+				}
+			}
+		} else {
+			h = sample_hash(tuple->key, key_sz);
+			for (j = h & mask; slot[j]; j = (j + 1) & mask) {
+				i = slot[j] - 1;
+				if (hash[i] != h || res[i])
+					continue;
+				SCAN_KEY(tuple, keys[i], key_sz);
+				if (memcmp(tuple->key, keys[i], key_sz))
+					continue;
+				for (; i >= 0; i = dup[i]) {
+					res[i] = tuple;
+					left--;
+				}
+				break;
+			}
+		}
+#undef memcmp
+		curr = tuple->key;
+		curr = curr + tuple->key_sz + tuple->val_sz;
+		tuple = (region_t *)curr;
+	}
+	free(slot);
+	free(hash);
+	free(dup);
+	return nkeys - left;
+}
+
+/* Sorted blocks.
+ * build_sorted_block() writes a set of keys as a region_t block in key
+ * order, which search() still scans linearly, and indexes it for the
+ * O(log n) strategies.  Those run over the index only and dereference
+ * a record to compare keys past the 8 bytes kept in the index.  Keys
+ * of a sorted block all have the same size. */
+#define SORTED_LINEAR	0
+#define SORTED_BINARY	1
+#define SORTED_INTERP	2
+#define SORTED_EYTZ	3
+#define SORTED_NSTRAT	4
+
+int sorted;
+
+typedef struct {
+	recidx_t  ri;      /* record offsets in key order */
+	char     *buf;     /* block the index was built from */
+	int       key_sz;
+	int       lcp;     /* prefix length shared by all keys */
+	uint64_t *ikey;    /* big-endian 8 key bytes after lcp */
+	uint32_t *eyt;     /* record at each 1-based Eytzinger position */
+	uint64_t *eytkey;  /* ikey of eyt[] */
+} sortidx_t;
+
+sortidx_t sortidx;
+
+static uint64_t
+load_be64(const char *key, int len)
+{
+	uint64_t v = 0;
+	int      cnt;
+
+	for (cnt = 0; cnt < 8; cnt++) {
+		v <<= 8;
+		if (cnt < len)
+			v |= (unsigned char)key[cnt];
+	}
+	return v;
+}
+
+static int sort_key_sz;
+
+static int
+cmp_keys(const void *a, const void *b)
+{
+	return memcmp(a, b, sort_key_sz);
+}
+
+static int
+eyt_fill(sortidx_t *si, int i, int k)
+{
+	if (k <= si->ri.nrec) {
+		i = eyt_fill(si, i, 2 * k);
+		si->eyt[k] = i;
+		si->eytkey[k] = si->ikey[i];
+		i = eyt_fill(si, i + 1, 2 * k + 1);
+	}
+	return i;
+}
+
+/* Sort the nkeys keys of key_sz bytes at keys, write them as a block of
+ * size bytes in buf and index it in si.  Keys that do not fit are
+ * dropped from the top.  Return the number of key bytes a full linear
+ * scan compares. */
+int
+build_sorted_block(sortidx_t *si, char *buf, int size, char *keys,
+		   int nkeys, int key_sz, int val_sz)
+{
+	region_t *tuple;
+	char     *curr, *first, *last;
+	int      cnt;
+
+	sort_key_sz = key_sz;
+	qsort(keys, nkeys, key_sz, cmp_keys);
+
+	curr = buf;
+	for (cnt = 0; cnt < nkeys && (curr + 8 + key_sz) < (buf + size); cnt++) {
+		tuple = (region_t *)curr;
+		tuple->key_sz = key_sz;
+		tuple->val_sz = val_sz;
+		memcpy(tuple->key, keys + (size_t)cnt * key_sz, key_sz);
+		curr = tuple->key + key_sz + val_sz;
+	}
+
+	build_recidx(&si->ri, buf, size, key_sz, KEYIDX_NONE);
+	assert(si->ri.nrec == cnt);
+	si->buf = buf;
+	si->key_sz = key_sz;
+	si->lcp = 0;
+	if (cnt) {
+		first = ((region_t *)(buf + si->ri.off[0]))->key;
+		last = ((region_t *)(buf + si->ri.off[cnt - 1]))->key;
+		while (si->lcp < key_sz && first[si->lcp] == last[si->lcp])
+			si->lcp++;
+	}
+	si->ikey = malloc((cnt + 1) * sizeof(*si->ikey));
+	si->eyt = malloc((cnt + 1) * sizeof(*si->eyt));
+	si->eytkey = malloc((cnt + 1) * sizeof(*si->eytkey));
+	assert(si->ikey && si->eyt && si->eytkey);
+	for (cnt = 0; cnt < si->ri.nrec; cnt++) {
+		tuple = (region_t *)(buf + si->ri.off[cnt]);
+		si->ikey[cnt] = load_be64(tuple->key + si->lcp, key_sz - si->lcp);
+	}
+	eyt_fill(si, 0, 1);
+	return si->ri.nrec * key_sz;
+}
+
+/* make_buf() for sorted blocks: keys made of the target key with their
+ * last bytes spread evenly below the target, which is the largest key
+ * and thus the last record */
+void
+make_sorted_buf(char *buf, int size, char *target_key, int key_sz,
+		int val_sz, int *bycmp)
+{
+	char     *keys, *k;
+	uint32_t num, max;
+	int      nkeys, tail, cnt, sw;
+
+	nkeys = 0;
+	while ((int64_t)nkeys * (8 + key_sz + val_sz) + 8 + key_sz < size)
+		nkeys++;
+	keys = malloc((size_t)(nkeys + 1) * key_sz);
+	assert(keys);
+	tail = key_sz < 4 ? key_sz : 4;
+	max = tail == 4 ? UINT32_MAX : (1u << (8 * tail)) - 1;
+	for (cnt = 0; cnt < nkeys; cnt++) {
+		k = keys + (size_t)cnt * key_sz;
+		memcpy(k, target_key, key_sz);
+		if (cnt == nkeys - 1)
+			break;
+		num = (uint32_t)((uint64_t)cnt * max / nkeys);
+		for (sw = 0; sw < tail; sw++)
+			k[key_sz - 1 - sw] = (char)(num >> (8 * sw));
+	}
+	/* hand the builder the keys in arbitrary order */
+	srand(1);
+	for (cnt = nkeys - 1; cnt > 0; cnt--) {
+		sw = rand() % (cnt + 1);
+		memcpy(keys + (size_t)nkeys * key_sz, keys + (size_t)cnt * key_sz, key_sz);
+		memcpy(keys + (size_t)cnt * key_sz, keys + (size_t)sw * key_sz, key_sz);
+		memcpy(keys + (size_t)sw * key_sz, keys + (size_t)nkeys * key_sz, key_sz);
+	}
+	*bycmp = build_sorted_block(&sortidx, buf, size, keys, nkeys, key_sz,
+				    val_sz);
+	free(keys);
+}
+
+/* Compare record i of buf with the key whose ikey is qk */
+static inline int
+sorted_cmp(sortidx_t *si, char *buf, int i, char *key, uint64_t qk,
+	   uint64_t rk)
+{
+	region_t *tuple;
+	int      off;
+
+	if (rk != qk)
+		return rk < qk ? -1 : 1;
+	off = si->lcp + 8;
+	if (off >= si->key_sz)
+		return 0;
+	tuple = (region_t *)(buf + si->ri.off[i]);
+	return memcmp(tuple->key + off, key + off, si->key_sz - off);
+}
+
+/* Check that key shares the block prefix and return its ikey */
+static inline int
+sorted_probe(sortidx_t *si, char *key, int key_sz, uint64_t *qk)
+{
+	if (key_sz != si->key_sz || si->ri.nrec == 0)
+		return 0;
+	if (memcmp(key, si->buf + si->ri.off[0] + 8, si->lcp))
+		return 0;
+	*qk = load_be64(key + si->lcp, key_sz - si->lcp);
+	return 1;
+}
+
+/* Binary search of key in records [lo, hi] */
+static region_t *
+sorted_bsearch(sortidx_t *si, char *buf, char *key, uint64_t qk, int lo,
+	       int hi)
+{
+	int mid, c;
+
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		c = sorted_cmp(si, buf, mid, key, qk, si->ikey[mid]);
+		if (c == 0)
+			return (region_t *)(buf + si->ri.off[mid]);
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return 0;
+}
+
+region_t *
+search_binary(char *buf, int size, char *key, int key_sz)
+{
+	sortidx_t *si = &sortidx;
+	uint64_t  qk;
+
+	if (!sorted_probe(si, key, key_sz, &qk))
+		return 0;
+	return sorted_bsearch(si, buf, key, qk, 0, si->ri.nrec - 1);
+}
+
+/* Interpolation on the 8 key bytes after the shared prefix, finished
+ * by a binary search once those bytes do not tell keys apart.  A
+ * bisection step follows every probe that did not halve the range, so
+ * skewed keys cost at most twice the binary search. */
+region_t *
+search_interp(char *buf, int size, char *key, int key_sz)
+{
+	sortidx_t *si = &sortidx;
+	uint64_t  qk, *ik = si->ikey;
+	int       lo, hi, pos, len, c, bisect;
+
+	if (!sorted_probe(si, key, key_sz, &qk))
+		return 0;
+	lo = 0;
+	hi = si->ri.nrec - 1;
+	bisect = 0;
+	while (lo <= hi && qk >= ik[lo] && qk <= ik[hi]) {
+		if (ik[lo] == ik[hi])
+			return sorted_bsearch(si, buf, key, qk, lo, hi);
+		len = hi - lo;
+		if (bisect)
+			pos = lo + len / 2;
+		else
+			pos = lo + (int)((double)(qk - ik[lo]) /
+					 (double)(ik[hi] - ik[lo]) * len);
+		c = sorted_cmp(si, buf, pos, key, qk, ik[pos]);
+		if (c == 0)
+			return (region_t *)(buf + si->ri.off[pos]);
+		if (c < 0)
+			lo = pos + 1;
+		else
+			hi = pos - 1;
+		bisect = !bisect && hi - lo > len / 2;
+	}
+	return 0;
+}
+
+/* Branch-free descent of the Eytzinger layout, prefetching the cache
+ * line of the great-grandchildren (16 keys ahead) */
+region_t *
+search_eytzinger(char *buf, int size, char *key, int key_sz)
+{
+	sortidx_t *si = &sortidx;
+	uint64_t  qk;
+	int       k, n = si->ri.nrec;
+
+	if (!sorted_probe(si, key, key_sz, &qk))
+		return 0;
+	k = 1;
+	while (k <= n) {
+		__builtin_prefetch(&si->eytkey[16 * k]);
+		k = 2 * k + (sorted_cmp(si, buf, si->eyt[k], key, qk,
+					si->eytkey[k]) < 0);
+	}
+	k >>= __builtin_ffs(~k);
+	if (k == 0 || sorted_cmp(si, buf, si->eyt[k], key, qk, si->eytkey[k]))
+		return 0;
+	return (region_t *)(buf + si->ri.off[si->eyt[k]]);
+}
+
+/* Hash-indexed blocks.
+ * A hashed block starts with an open addressing table of the records,
+ * Swiss table style: one control byte per slot, 0x80 for an empty slot
+ * or the low 7 bits of the key hash, and the record offset of the slot.
+ * Slots come in groups of HASHED_GROUP, a lookup compares the control
+ * bytes of a whole group with the 7 hash bits at once (SSE2 on x86) and
+ * only compares the keys of the matching slots; the first group holding
+ * an empty slot ends the probe.  The region_t records follow the table.
+ * Lookups are of full keys, as search() does with keys of one size, and
+ * a key found several times in the block maps to its first record. */
+#define HASHED_GROUP	16
+#define HASHED_EMPTY	0x80
+#define HASHED_MAGIC	0x48534248	/* "HBSH" */
+
+#if defined(__SSE2__) && !defined(MPPA)
+#include <emmintrin.h>
+#endif
+
+int hashed;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t ngroups;    /* power of 2 */
+	uint32_t nrec;       /* distinct keys in the table */
+	uint32_t rec_off;    /* records, from the block start */
+	uint32_t rec_sz;     /* size given to search() for the records */
+	uint32_t pad[3];
+	/* uint8_t ctrl[ngroups * HASHED_GROUP]; */
+	/* uint32_t off[ngroups * HASHED_GROUP]; */
+} hashed_hdr_t;
+
+#define HASHED_CTRL(h)	((uint8_t *)((h) + 1))
+#define HASHED_OFF(h)	((uint32_t *)(HASHED_CTRL(h) + \
+				      (h)->ngroups * HASHED_GROUP))
+
+/* Bit i set when control byte i of the group at ctrl is c */
+static inline unsigned
+hashed_match(const uint8_t *ctrl, uint8_t c)
+{
+#if defined(__SSE2__) && !defined(MPPA)
+	__m128i g = _mm_loadu_si128((const __m128i *)ctrl);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(c)));
+#else
+	unsigned m = 0;
+	int      i;
+
+	for (i = 0; i < HASHED_GROUP; i++)
+		m |= (unsigned)(ctrl[i] == c) << i;
+	return m;
+#endif
+}
+
+static uint32_t
+hashed_ngroups(int nrec)
+{
+	uint32_t ngroups = 1;
+
+	/* at most 7/8 full */
+	while ((uint64_t)ngroups * HASHED_GROUP * 7 < (uint64_t)nrec * 8)
+		ngroups <<= 1;
+	return ngroups;
+}
+
+/* Table bytes in front of the records of a block of nrec records */
+size_t
+hashed_table_sz(int nrec)
+{
+	return (sizeof(hashed_hdr_t) +
+		(size_t)hashed_ngroups(nrec) * HASHED_GROUP * 5 + 63) &
+		~(size_t)63;
+}
+
+static region_t *
+hashed_probe(hashed_hdr_t *h, char *recs, char *key, int key_sz,
+	     uint64_t hash)
+{
+	uint8_t  *ctrl = HASHED_CTRL(h);
+	uint32_t *off = HASHED_OFF(h);
+	uint32_t g = (uint32_t)(hash >> 7) & (h->ngroups - 1);
+	uint8_t  h2 = hash & 0x7f;
+	region_t *tuple;
+	unsigned m, step;
+	int      i;
+
+	for (step = 1; step <= h->ngroups; step++) {
+		m = hashed_match(ctrl + g * HASHED_GROUP, h2);
+		while (m) {
+			i = g * HASHED_GROUP + __builtin_ctz(m);
+			m &= m - 1;
+			tuple = (region_t *)(recs + off[i]);
+			if (tuple->key_sz == (uint32_t)key_sz &&
+			    memcmp(tuple->key, key, key_sz) == 0)
+				return tuple;
+		}
+		if (hashed_match(ctrl + g * HASHED_GROUP, HASHED_EMPTY))
+			return 0;
+		/* triangular steps visit every group */
+		g = (g + step) & (h->ngroups - 1);
+	}
+	return 0;
+}
+
+/* Build in dst the hashed block of the size bytes block at buf, dst
+ * has room for hashed_table_sz(nrec) + size bytes.  Return the size of
+ * the hashed block. */
+int
+build_hashed_block(char *dst, char *buf, int size, int key_sz)
+{
+	hashed_hdr_t *h = (hashed_hdr_t *)dst;
+	recidx_t     ri;
+	region_t     *tuple;
+	uint8_t      *ctrl;
+	uint32_t     *off, g, step;
+	uint64_t     hash;
+	char         *recs;
+	unsigned     m;
+	int          cnt, i;
+
+	build_recidx(&ri, buf, size, key_sz, KEYIDX_NONE);
+	memset(h, 0, sizeof(*h));
+	h->magic = HASHED_MAGIC;
+	h->ngroups = hashed_ngroups(ri.nrec);
+	h->rec_off = hashed_table_sz(ri.nrec);
+	h->rec_sz = size;
+	recs = dst + h->rec_off;
+	memcpy(recs, buf, size);
+	ctrl = HASHED_CTRL(h);
+	off = HASHED_OFF(h);
+	memset(ctrl, HASHED_EMPTY, h->ngroups * HASHED_GROUP);
+	for (cnt = 0; cnt < ri.nrec; cnt++) {
+		tuple = (region_t *)(recs + ri.off[cnt]);
+		hash = key_hash64(tuple->key, tuple->key_sz);
+		if (hashed_probe(h, recs, tuple->key, tuple->key_sz, hash))
+			continue;	/* keep the first record of a key */
+		g = (uint32_t)(hash >> 7) & (h->ngroups - 1);
+		for (step = 1; ; step++) {
+			m = hashed_match(ctrl + g * HASHED_GROUP, HASHED_EMPTY);
+			if (m)
+				break;
+			g = (g + step) & (h->ngroups - 1);
+		}
+		i = g * HASHED_GROUP + __builtin_ctz(m);
+		ctrl[i] = hash & 0x7f;
+		off[i] = ri.off[cnt];
+		h->nrec++;
+	}
+	free(ri.off);
+	return h->rec_off + size;
+}
+
+region_t *
+search_hashed(char *buf, int size, char *key, int key_sz)
+{
+	hashed_hdr_t *h = (hashed_hdr_t *)buf;
+
+	assert(h->magic == HASHED_MAGIC);
+	return hashed_probe(h, buf + h->rec_off, key, key_sz,
+			    key_hash64(key, key_sz));
+}
+
+/* search() of the records of a hashed block, for comparison */
+region_t *
+search_hashed_linear(char *buf, int size, char *key, int key_sz)
+{
+	hashed_hdr_t *h = (hashed_hdr_t *)buf;
+
+	return search(buf + h->rec_off, h->rec_sz, key, key_sz);
+}
+
+/* Front-coded blocks.
+ * The keys of a sorted block are stored as in the blocks of LevelDB
+ * tables: every fc_interval-th key, a restart point, is stored in full,
+ * the others as the number of bytes shared with the previous key and the
+ * remaining bytes.  An entry is the shared and the remaining key lengths
+ * and the value size as varints, then the remaining key bytes and the
+ * value.  The offsets of the restart points come first, so a lookup
+ * binary searches the restart keys and scans forward from the last one
+ * not above the key.  The scan tracks the bytes the key has in common
+ * with the previous entry and only compares the remaining bytes of the
+ * entries that share all of them, the keys are never rebuilt. */
+#define FCBLK_MAGIC	0x4b424346	/* "FCBK" */
+
+int frontcoded;
+int fc_interval = 16;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t nrec;
+	uint32_t interval;
+	uint32_t nrestart;
+	uint32_t data_sz;    /* entries, following the restart offsets */
+	uint32_t pad[3];
+	/* uint32_t restart[nrestart]; entry offsets from the first entry */
+} fcblk_hdr_t;
+
+/* Bytes and 64-byte lines of a block read by one lookup */
+typedef struct {
+	char     *base;
+	uint8_t  *map;       /* one byte per line of the block */
+	uint64_t  bytes;
+	uint64_t  lines;
+} touch_t;
+
+static void
+touch(touch_t *t, const void *p, size_t len)
+{
+	size_t line;
+
+	t->bytes += len;
+	for (line = ((const char *)p - t->base) / 64;
+	     len && line <= ((const char *)p + len - 1 - t->base) / 64; line++) {
+		t->lines += !t->map[line];
+		t->map[line] = 1;
+	}
+}
+
+static uint8_t *
+varint_put(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static const uint8_t *
+varint_get(const uint8_t *p, uint32_t *v)
+{
+	uint32_t r = 0;
+	int      shift;
+
+	for (shift = 0; *p & 0x80; shift += 7)
+		r |= (uint32_t)(*p++ & 0x7f) << shift;
+	*v = r | (uint32_t)*p++ << shift;
+	return p;
+}
+
+/* Length of the common prefix of the n bytes at a and b */
+static inline uint32_t
+common_prefix(const char *a, const char *b, uint32_t n)
+{
+	uint64_t x, y;
+	uint32_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		if (x != y)
+			return i + __builtin_ctzll(x ^ y) / 8;
+	}
+	while (i < n && a[i] == b[i])
+		i++;
+	return i;
+}
+
+/* Largest front-coded block of records that span size bytes, the
+ * value of the last record of a block can run past its end */
+size_t
+fc_bound(int size, int interval)
+{
+	/* records of 9 bytes or more, each with up to 7 more varint bytes
+	 * and maybe a restart offset */
+	return sizeof(fcblk_hdr_t) + (size_t)size +
+		(size_t)size / 9 * (7 + 4 / (interval > 0 ? interval : 1) + 1);
+}
+
+/* Front-code the records of the size bytes block at buf that search()
+ * visits for keys of key_sz, which are in key order, into dst.  Return
+ * the size of the front-coded block. */
+int
+build_fc_block(char *dst, char *buf, int size, int key_sz, int interval)
+{
+	fcblk_hdr_t *h = (fcblk_hdr_t *)dst;
+	recidx_t    ri;
+	region_t    *tuple;
+	uint32_t    *restart, shared, nrec, cnt;
+	char        *prev = NULL;
+	uint8_t     *p;
+	uint32_t    prev_sz = 0;
+	int64_t     span = size;
+
+	if (interval < 1)
+		interval = 1;
+	build_recidx(&ri, buf, size, key_sz, KEYIDX_NONE);
+	nrec = ri.nrec;
+	memset(h, 0, sizeof(*h));
+	h->magic = FCBLK_MAGIC;
+	h->nrec = nrec;
+	h->interval = interval;
+	h->nrestart = (nrec + interval - 1) / interval;
+	restart = (uint32_t *)(h + 1);
+	p = (uint8_t *)(restart + h->nrestart);
+	for (cnt = 0; cnt < nrec; cnt++) {
+		tuple = (region_t *)(buf + ri.off[cnt]);
+		shared = 0;
+		if (cnt % interval == 0)
+			restart[cnt / interval] = p - (uint8_t *)(restart + h->nrestart);
+		else
+			shared = common_prefix(tuple->key, prev,
+					       tuple->key_sz < prev_sz ?
+					       tuple->key_sz : prev_sz);
+		p = varint_put(p, shared);
+		p = varint_put(p, tuple->key_sz - shared);
+		p = varint_put(p, tuple->val_sz);
+		memcpy(p, tuple->key + shared,
+		       tuple->key_sz - shared + tuple->val_sz);
+		p += tuple->key_sz - shared + tuple->val_sz;
+		prev = tuple->key;
+		prev_sz = tuple->key_sz;
+		if (tuple->key + tuple->key_sz + tuple->val_sz - buf > span)
+			span = tuple->key + tuple->key_sz + tuple->val_sz - buf;
+	}
+	free(ri.off);
+	h->data_sz = p - (uint8_t *)(restart + h->nrestart);
+	assert((size_t)((char *)p - dst) <= fc_bound(span, interval));
+	return (char *)p - dst;
+}
+
+/* Value of key in the front-coded block at blk or NULL, *val_sz gets its
+ * size.  t, if not NULL, gets the bytes read. */
+static inline char *
+fc_lookup(char *blk, char *key, uint32_t key_sz, uint32_t *val_sz,
+	  touch_t *t)
+{
+	fcblk_hdr_t   *h = (fcblk_hdr_t *)blk;
+	uint32_t      *restart = (uint32_t *)(h + 1);
+	const uint8_t *data = (const uint8_t *)(restart + h->nrestart);
+	const uint8_t *p, *q, *end = data + h->data_sz;
+	uint32_t      shared, rest, vsz, match, n, l;
+	int           lo, hi, mid, c;
+
+	if (h->nrestart == 0)
+		return 0;
+	/* last restart key not above key */
+	lo = 0;
+	hi = h->nrestart - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		p = data + restart[mid];
+		p = varint_get(varint_get(varint_get(p, &shared), &rest), &vsz);
+		n = rest < key_sz ? rest : key_sz;
+		if (t) {
+			touch(t, restart + mid, 4);
+			touch(t, data + restart[mid], p - (data + restart[mid]) + n);
+		}
+		c = memcmp(p, key, n);
+		if (c < 0 || (c == 0 && rest <= key_sz))
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	/* match is the length of the common prefix of key and the previous
+	 * entry, which is below key */
+	match = 0;
+	for (p = data + restart[lo]; p < end; p += rest + vsz) {
+		q = p;
+		p = varint_get(varint_get(varint_get(p, &shared), &rest), &vsz);
+		if (t)
+			touch(t, q, p - q);
+		if (shared < match)
+			return 0;	/* above key from byte `shared' on */
+		if (shared > match)
+			continue;	/* still below key at byte `match' */
+		n = rest < key_sz - match ? rest : key_sz - match;
+		l = common_prefix((const char *)p, key + match, n);
+		if (t)
+			touch(t, p, l < n ? l + 1 : n);
+		if (l == n) {
+			if (rest == key_sz - match) {
+				*val_sz = vsz;
+				return (char *)p + rest;
+			}
+			if (rest > key_sz - match)
+				return 0;	/* key is a prefix of the entry */
+		} else if ((uint8_t)p[l] > (uint8_t)key[match + l]) {
+			return 0;
+		}
+		match += l;
+	}
+	return 0;
+}
+
+char *
+search_frontcoded(char *blk, char *key, int key_sz, uint32_t *val_sz)
+{
+	assert(((fcblk_hdr_t *)blk)->magic == FCBLK_MAGIC);
+	return fc_lookup(blk, key, key_sz, val_sz, NULL);
+}
+
+/* Bytes of the region_t block at buf that search() reads to look key up */
+void
+region_touch(char *buf, int size, char *key, int key_sz, touch_t *t)
+{
+	region_t *tuple;
+	char     *curr = buf;
+	uint32_t cmpsz, l;
+
+	while ((curr + 8 + key_sz) < (buf + size)) {
+		tuple = (region_t *)curr;
+		touch(t, tuple, 8);
+		cmpsz = tuple->key_sz < (uint32_t)key_sz ? tuple->key_sz : key_sz;
+		l = common_prefix(tuple->key, key, cmpsz);
+		touch(t, tuple->key, l < cmpsz ? l + 1 : cmpsz);
+		if (l == cmpsz)
+			return;
+		curr = tuple->key + tuple->key_sz + tuple->val_sz;
+	}
+}
+
+/* Number of scanning threads, 1 keeps the plain serial search() */
+int nthreads = 1;
+
+#ifndef MPPA
+/* Parallel partitioned scan for x86.
+ * The record boundaries of the block are indexed once, the index is
+ * split in nthreads contiguous ranges and each range is scanned by a
+ * thread of a persistent pool.  The caller thread scans range 0.
+ * Workers publish the lowest matching record number and stop as soon
+ * as a match before their current record is known, so the result is
+ * the same record the serial search() returns. */
+#include <pthread.h>
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t  go;
+	pthread_cond_t  done;
+	pthread_t      *tid;
+	int             nthreads;
+	unsigned        gen;     /* bumped for each new search */
+	int             pending; /* workers still scanning */
+	/* current search */
+	recidx_t       *idx;
+	char           *buf;
+	char           *key;
+	int             key_sz;
+	int             nrec;    /* records visited for this key size */
+	int             hit;     /* lowest matching record, nrec if none */
+} pool_t;
+
+pool_t pool;
+
+void
+scan_range(int tid)
+{
+	region_t *tuple;
+	int      i, lo, hi, cmpsz, hit;
+
+	lo = (int)((int64_t)pool.nrec * tid / pool.nthreads);
+	hi = (int)((int64_t)pool.nrec * (tid + 1) / pool.nthreads);
+	for (i = lo; i < hi; i++) {
+		if (i > __atomic_load_n(&pool.hit, __ATOMIC_RELAXED))
+			return;
+		tuple = (region_t *)(pool.buf + pool.idx->off[i]);
+		cmpsz = pool.key_sz;
+		if (tuple->key_sz < cmpsz) {
+			cmpsz = tuple->key_sz;
+		}
+		SCAN_STAT(tuple, pool.key, cmpsz);
+		if (memcmp(tuple->key, pool.key, cmpsz) == 0) {
+			hit = __atomic_load_n(&pool.hit, __ATOMIC_RELAXED);
+			while (i < hit &&
+			       !__atomic_compare_exchange_n(&pool.hit, &hit, i, 0,
+							    __ATOMIC_RELAXED,
+							    __ATOMIC_RELAXED))
+				;
+			return;
+		}
+	}
+}
+
+void *
+pool_worker(void *arg)
+{
+	int      tid = (int)(intptr_t)arg;
+	unsigned gen = 0;
+
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		while (pool.gen == gen)
+			pthread_cond_wait(&pool.go, &pool.lock);
+		gen = pool.gen;
+		pthread_mutex_unlock(&pool.lock);
+		scan_range(tid);
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.pending == 0)
+			pthread_cond_signal(&pool.done);
+	}
+	return NULL;
+}
+
+void
+pool_init(recidx_t *ri, int threads)
+{
+	int cnt;
+
+	if (threads > ri->nrec)
+		threads = ri->nrec;
+	if (threads < 1)
+		threads = 1;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.go, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	pool.idx = ri;
+	pool.nthreads = threads;
+	pool.gen = 0;
+	pool.tid = malloc(threads * sizeof(*pool.tid));
+	assert(pool.tid);
+	for (cnt = 1; cnt < threads; cnt++) {
+		if (pthread_create(&pool.tid[cnt], NULL, pool_worker,
+				   (void *)(intptr_t)cnt)) {
+			printf("pthread_create failed\n");
+			exit(1);
+		}
+	}
+}
+
+region_t *
+search_par(char *buf, int size, char *key, int key_sz)
+{
+	pthread_mutex_lock(&pool.lock);
+	pool.buf = buf;
+	pool.key = key;
+	pool.key_sz = key_sz;
+	pool.nrec = recidx_limit(pool.idx, size, key_sz);
+	pool.hit = pool.nrec;
+	pool.pending = pool.nthreads - 1;
+	pool.gen++;
+	pthread_cond_broadcast(&pool.go);
+	pthread_mutex_unlock(&pool.lock);
+
+	scan_range(0);
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.pending)
+		pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+
+	if (pool.hit == pool.nrec)
+		return 0;
+	return (region_t *)(buf + pool.idx->off[pool.hit]);
+}
+#endif /* !MPPA */
+
+#ifndef MPPA
+/* Concurrent readers of a rewritten block.
+ * rcu_readers threads look the target key up in the current block while
+ * a writer thread rebuilds the block every rcu_wperiod us and publishes
+ * the new one by swapping the block pointer.  The old block is reclaimed
+ * with epochs: a reader announces the global epoch before it loads the
+ * block pointer and clears it when its lookup is done, the writer bumps
+ * the epoch after the swap, and a block retired at epoch e is freed once
+ * no reader is inside an epoch below e.  With reclaim=sync the writer
+ * waits for that grace period before freeing the old block, as
+ * synchronize_rcu() does; with reclaim=defer it queues the block, as
+ * call_rcu() does, and frees the queued blocks whose grace period is
+ * over at each publish. */
+#include <sched.h>
+#include <time.h>
+
+#define RCU_MAX_READERS	64
+#define RCU_DEFER_MAX	1024
+
+#define RECLAIM_SYNC	0
+#define RECLAIM_DEFER	1
+
+const char *reclaim_names[] = { "sync", "defer", NULL };
+
+int rcu_readers;            /* reader threads, 0 for none */
+int rcu_reclaim;
+int rcu_wperiod = 1000;     /* us between publishes, -1 for no writer */
+
+typedef struct {
+	uint64_t   epoch;       /* epoch of the current lookup, 0 if none */
+	char       pad[56];
+	lat_hist_t hist;
+	pthread_t  tid;
+	int        rep;
+} __attribute__((aligned(64))) rcu_reader_t;
+
+typedef struct {
+	char     *buf;
+	uint64_t  epoch;        /* epoch the block was retired at */
+} rcu_retired_t;
+
+static rcu_reader_t *rcu_rd;
+static char         *rcu_blk;
+static uint64_t      rcu_epoch = 1;
+static int           rcu_done;          /* readers done */
+static int           rcu_size;
+static char         *rcu_key;
+static int           rcu_key_sz;
+
+static void *
+rcu_reader(void *arg)
+{
+	rcu_reader_t *r = arg;
+	region_t     *res;
+	uint64_t     t0;
+	int          cnt;
+
+	for (cnt = 0; cnt < r->rep; cnt++) {
+		t0 = lat_now_ns();
+		__atomic_store_n(&r->epoch, __atomic_load_n(&rcu_epoch,
+							    __ATOMIC_SEQ_CST),
+				 __ATOMIC_SEQ_CST);
+		res = search(__atomic_load_n(&rcu_blk, __ATOMIC_SEQ_CST),
+			     rcu_size, rcu_key, rcu_key_sz);
+		__atomic_store_n(&r->epoch, 0, __ATOMIC_RELEASE);
+		lat_record(&r->hist, lat_now_ns() - t0);
+		assert(res);
+	}
+	__atomic_add_fetch(&rcu_done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/* 1 once no reader is inside an epoch below e */
+static int
+rcu_quiescent(uint64_t e)
+{
+	uint64_t re;
+	int      cnt;
+
+	for (cnt = 0; cnt < rcu_readers; cnt++) {
+		re = __atomic_load_n(&rcu_rd[cnt].epoch, __ATOMIC_SEQ_CST);
+		if (re && re < e)
+			return 0;
+	}
+	return 1;
+}
+
+/* Readers lookups per second, latency of the lookups and of the
+ * publishes, the most blocks waiting to be freed */
+double     rcu_lps;
+lat_hist_t rcu_hist;
+lat_hist_t rcu_pub_hist;
+int        rcu_pending_max;
+
+void
+rcu_bench(int size, int rep, char *key, int key_sz, int val_sz)
+{
+	rcu_retired_t retired[RCU_DEFER_MAX];
+	struct timespec next;
+	perf_t   bm;
+	uint64_t t0, e;
+	char     *blk, *old;
+	int      nretired, bycmp, cnt, i, b;
+
+	if (rcu_readers > RCU_MAX_READERS)
+		rcu_readers = RCU_MAX_READERS;
+	rcu_rd = calloc(rcu_readers, sizeof(*rcu_rd));
+	assert(rcu_rd);
+	rcu_size = size;
+	rcu_key = key;
+	rcu_key_sz = key_sz;
+	rcu_blk = malloc(size + 8 + key_sz + val_sz);
+	assert(rcu_blk);
+	make_buf(rcu_blk, size, key, key_sz, val_sz, &bycmp, NULL);
+
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < rcu_readers; cnt++) {
+		rcu_rd[cnt].rep = rep;
+		if (pthread_create(&rcu_rd[cnt].tid, NULL, rcu_reader,
+				   &rcu_rd[cnt])) {
+			printf("pthread_create failed\n");
+			exit(1);
+		}
+	}
+
+	/* the writer */
+	nretired = 0;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (rcu_wperiod >= 0 &&
+	       __atomic_load_n(&rcu_done, __ATOMIC_ACQUIRE) < rcu_readers) {
+		blk = malloc(size + 8 + key_sz + val_sz);
+		assert(blk);
+		make_buf(blk, size, key, key_sz, val_sz, &bycmp, NULL);
+
+		t0 = lat_now_ns();
+		old = __atomic_exchange_n(&rcu_blk, blk, __ATOMIC_SEQ_CST);
+		e = __atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_SEQ_CST);
+		if (rcu_reclaim == RECLAIM_DEFER) {
+			/* wait for the oldest block if the queue is full */
+			while (nretired == RCU_DEFER_MAX &&
+			       !rcu_quiescent(retired[0].epoch))
+				sched_yield();
+			retired[nretired].buf = old;
+			retired[nretired].epoch = e;
+			nretired++;
+			for (i = b = 0; i < nretired; i++) {
+				if (rcu_quiescent(retired[i].epoch))
+					free(retired[i].buf);
+				else
+					retired[b++] = retired[i];
+			}
+			nretired = b;
+			if (nretired > rcu_pending_max)
+				rcu_pending_max = nretired;
+		} else {
+			while (!rcu_quiescent(e))
+				sched_yield();
+			free(old);
+		}
+		lat_record(&rcu_pub_hist, lat_now_ns() - t0);
+
+		next.tv_nsec += rcu_wperiod * 1000L;
+		while (next.tv_nsec >= 1000000000L) {
+			next.tv_nsec -= 1000000000L;
+			next.tv_sec++;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+	}
+	for (cnt = 0; cnt < rcu_readers; cnt++)
+		pthread_join(rcu_rd[cnt].tid, NULL);
+	stop_timer(&bm);
+	rcu_lps = (double)rep * rcu_readers / (usec_timer(&bm) * 1e-6);
+
+	for (cnt = 0; cnt < rcu_readers; cnt++) {
+		for (b = 0; b < LAT_NBUCKET; b++)
+			rcu_hist.count[b] += rcu_rd[cnt].hist.count[b];
+		rcu_hist.n += rcu_rd[cnt].hist.n;
+		if (rcu_rd[cnt].hist.max > rcu_hist.max)
+			rcu_hist.max = rcu_rd[cnt].hist.max;
+	}
+	for (i = 0; i < nretired; i++)
+		free(retired[i].buf);
+	free(rcu_blk);
+	free(rcu_rd);
+}
+#endif /* !MPPA */
+
+#ifndef MPPA
+/* Block files.
+ * A block file is a header page, the region_t block as built in memory
+ * and an optional copy of its side index.  The loader maps it read-only
+ * and the searches run in place on the mapping, no byte is copied. */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BLKFILE_MAGIC	0x4b4c4253	/* "SBLK" */
+#define BLKFILE_VERSION	1
+#define BLKFILE_HDR_SZ	4096		/* the block starts page aligned */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t blk_off;   /* region_t block */
+	uint64_t blk_sz;
+	uint64_t nrec;      /* index, all offsets 0 if there is none */
+	uint32_t min_ksz;
+	uint32_t max_ksz;
+	uint64_t off_off;   /* nrec uint32_t record offsets */
+	uint64_t pfx_off;   /* nrec uint64_t key prefixes */
+	uint64_t hash_off;  /* nrec uint32_t key hashes */
+	uint64_t file_sz;
+} blkfile_hdr_t;
+
+#define ADVICE_NONE	0
+#define ADVICE_SEQ	1
+#define ADVICE_RANDOM	2
+#define ADVICE_WILLNEED	3
+
+const char *advice_names[] = { "none", "sequential", "random", "willneed",
+			       NULL };
+
+char *blkfile;          /* path of the block file, NULL for no file mode */
+int  blkfile_advice;
+int  blkfile_huge;      /* ask for transparent huge pages on the mapping */
+int  blkfile_cold = 10; /* cold scans, each from a dropped page cache */
+
+typedef struct {
+	int      fd;
+	char     *map;
+	uint64_t map_sz;
+	char     *blk;     /* block inside the mapping */
+	int      blk_sz;
+	recidx_t ri;       /* index inside the mapping, nrec 0 if none */
+} blkmap_t;
+
+static void
+write_all(int fd, const void *buf, uint64_t len, uint64_t off)
+{
+	ssize_t n;
+
+	while (len) {
+		n = pwrite(fd, buf, len, off);
+		if (n <= 0) {
+			perror("pwrite");
+			exit(1);
+		}
+		buf = (const char *)buf + n;
+		len -= n;
+		off += n;
+	}
+}
+
+/* Write the block of size bytes at buf, and ri if not NULL, to path */
+void
+write_blkfile(const char *path, char *buf, int size, recidx_t *ri)
+{
+	blkfile_hdr_t hdr;
+	uint64_t      off;
+	int           fd;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = BLKFILE_MAGIC;
+	hdr.version = BLKFILE_VERSION;
+	hdr.blk_off = BLKFILE_HDR_SZ;
+	hdr.blk_sz = size;
+	off = (hdr.blk_off + size + 7) & ~(uint64_t)7;
+	if (ri) {
+		hdr.nrec = ri->nrec;
+		hdr.min_ksz = ri->min_ksz;
+		hdr.max_ksz = ri->max_ksz;
+		hdr.off_off = off;
+		off += ((uint64_t)ri->nrec * sizeof(*ri->off) + 7) & ~(uint64_t)7;
+		if (ri->pfx) {
+			hdr.pfx_off = off;
+			off += (uint64_t)ri->nrec * sizeof(*ri->pfx);
+		}
+		if (ri->hash) {
+			hdr.hash_off = off;
+			off += (uint64_t)ri->nrec * sizeof(*ri->hash);
+		}
+	}
+	hdr.file_sz = off;
+
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	write_all(fd, &hdr, sizeof(hdr), 0);
+	write_all(fd, buf, size, hdr.blk_off);
+	if (hdr.off_off)
+		write_all(fd, ri->off, hdr.nrec * sizeof(*ri->off), hdr.off_off);
+	if (hdr.pfx_off)
+		write_all(fd, ri->pfx, hdr.nrec * sizeof(*ri->pfx), hdr.pfx_off);
+	if (hdr.hash_off)
+		write_all(fd, ri->hash, hdr.nrec * sizeof(*ri->hash), hdr.hash_off);
+	if (ftruncate(fd, hdr.file_sz) || fsync(fd)) {
+		perror(path);
+		exit(1);
+	}
+	close(fd);
+}
+
+/* The n items of item_sz bytes at off lie inside the mapping */
+static int
+blkfile_in_map(blkmap_t *m, uint64_t off, uint64_t n, uint64_t item_sz)
+{
+	return off <= m->map_sz && n <= (m->map_sz - off) / item_sz;
+}
+
+/* Map the block file opened on m->fd, return 0 if it is not valid */
+int
+map_blkfile(blkmap_t *m, int advice, int huge)
+{
+	static const int madv[] = {
+		MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED
+	};
+	blkfile_hdr_t *hdr;
+	struct stat   st;
+
+	if (fstat(m->fd, &st) || st.st_size < BLKFILE_HDR_SZ)
+		return 0;
+	m->map_sz = st.st_size;
+	m->map = mmap(NULL, m->map_sz, PROT_READ, MAP_SHARED, m->fd, 0);
+	if (m->map == MAP_FAILED)
+		return 0;
+	hdr = (blkfile_hdr_t *)m->map;
+	if (hdr->magic != BLKFILE_MAGIC || hdr->version != BLKFILE_VERSION ||
+	    hdr->file_sz > m->map_sz ||
+	    !blkfile_in_map(m, hdr->blk_off, hdr->blk_sz, 1) ||
+	    hdr->blk_sz > INT32_MAX ||
+	    (hdr->off_off &&
+	     (hdr->nrec > INT32_MAX ||
+	      !blkfile_in_map(m, hdr->off_off, hdr->nrec, sizeof(uint32_t)) ||
+	      (hdr->pfx_off &&
+	       !blkfile_in_map(m, hdr->pfx_off, hdr->nrec, sizeof(uint64_t))) ||
+	      (hdr->hash_off &&
+	       !blkfile_in_map(m, hdr->hash_off, hdr->nrec,
+			       sizeof(uint32_t)))))) {
+		munmap(m->map, m->map_sz);
+		return 0;
+	}
+	if (madvise(m->map, m->map_sz, madv[advice]))
+		perror("madvise");
+#ifdef MADV_HUGEPAGE
+	if (huge && madvise(m->map, m->map_sz, MADV_HUGEPAGE))
+		perror("madvise(MADV_HUGEPAGE)");
+#endif
+	m->blk = m->map + hdr->blk_off;
+	m->blk_sz = hdr->blk_sz;
+	memset(&m->ri, 0, sizeof(m->ri));
+	if (hdr->off_off) {
+		m->ri.nrec = hdr->nrec;
+		m->ri.min_ksz = hdr->min_ksz;
+		m->ri.max_ksz = hdr->max_ksz;
+		m->ri.off = (uint32_t *)(m->map + hdr->off_off);
+		if (hdr->pfx_off)
+			m->ri.pfx = (uint64_t *)(m->map + hdr->pfx_off);
+		if (hdr->hash_off)
+			m->ri.hash = (uint32_t *)(m->map + hdr->hash_off);
+	}
+	return 1;
+}
+
+void
+unmap_blkfile(blkmap_t *m)
+{
+	munmap(m->map, m->map_sz);
+}
+#endif /* !MPPA */
+
+/* Time rep lookups with fn cycling over the nkeys keys, return the ns
+ * per lookup */
+double
+lookup_ns(search_fn_t fn, char *ptr, int size, char **keys, int nkeys,
+	  int key_sz, int rep)
+{
+	perf_t   bm;
+	region_t *r;
+	char     *tmp;
+	int      cnt;
+
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		tmp = kill_cache(ptr);
+		r = fn(tmp, size, keys[cnt % nkeys], key_sz);
+		assert(r || 1);
+	}
+	stop_timer(&bm);
+	return usec_timer(&bm) * 1e3 / rep;
+}
+
+/* Filter false positive rate and miss latency, with and without the
+ * filter, over FILTER_NPROBE random keys that are not in the block */
+#define FILTER_NPROBE 10000
+
+double filter_fpr;
+double filter_miss_ns;
+double filter_miss_ns_nofilter;
+
+void
+filter_bench(char *ptr, int size, int rep, int key_sz)
+{
+	char **probe;
+	int  neg, fp, cnt, i;
+
+	probe = malloc(FILTER_NPROBE * sizeof(*probe));
+	assert(probe);
+	srand(3);
+	neg = fp = 0;
+	for (cnt = 0; cnt < FILTER_NPROBE; cnt++) {
+		probe[neg] = malloc(key_sz);
+		assert(probe[neg]);
+		for (i = 0; i < key_sz; i++)
+			probe[neg][i] = rand();
+		if (search(ptr, size, probe[neg], key_sz)) {
+			free(probe[neg]);
+			continue;
+		}
+		fp += filter_may_contain(&blkfilter, probe[neg], key_sz);
+		neg++;
+	}
+	filter_fpr = neg ? (double)fp / neg : 0;
+	if (neg) {
+		filter_miss_ns = lookup_ns(search_filtered, ptr, size, probe, neg,
+					   key_sz, rep);
+		filter_miss_ns_nofilter = lookup_ns(filtered_fn, ptr, size, probe,
+						    neg, key_sz, rep);
+	}
+	while (neg--)
+		free(probe[neg]);
+	free(probe);
+}
+
+/* ns per key of a batch looked up by search_many() and by one search()
+ * per key.  The batch holds the target key and random keys. */
+double batch_ns_many;
+double batch_ns_search;
+
+void
+batch_bench(char *ptr, int size, int rep, char *key, int key_sz, int nkeys)
+{
+	perf_t   bm;
+	region_t **res, *r;
+	char     **keys, *tmp;
+	int      cnt, i;
+
+	keys = malloc(nkeys * sizeof(*keys));
+	res = malloc(nkeys * sizeof(*res));
+	assert(keys && res);
+	srand(4);
+	for (i = 0; i < nkeys; i++) {
+		keys[i] = malloc(key_sz);
+		assert(keys[i]);
+		for (cnt = 0; cnt < key_sz; cnt++)
+			keys[i][cnt] = i ? rand() : key[cnt];
+	}
+	/* same answers both ways */
+	search_many(ptr, size, keys, nkeys, key_sz, res);
+	for (i = 0; i < nkeys; i++)
+		assert(res[i] == search(ptr, size, keys[i], key_sz));
+
+	init_timer(&bm);
+#ifdef SCAN_STATS
+	scan_begin();
+#endif
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		tmp = kill_cache(ptr);
+		search_many(tmp, size, keys, nkeys, key_sz, res);
+	}
+	stop_timer(&bm);
+#ifdef SCAN_STATS
+	scan_end(&scan_batch, (uint64_t)rep * nkeys);
+#endif
+	batch_ns_many = usec_timer(&bm) * 1e3 / ((double)rep * nkeys);
+
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		tmp = kill_cache(ptr);
+		for (i = 0; i < nkeys; i++) {
+			r = search(tmp, size, keys[i], key_sz);
+			assert(r || 1);
+		}
+	}
+	stop_timer(&bm);
+	batch_ns_search = usec_timer(&bm) * 1e3 / ((double)rep * nkeys);
+
+	for (i = 0; i < nkeys; i++)
+		free(keys[i]);
+	free(keys);
+	free(res);
+}
+
+/* ns per block of groups of `group' cache-defeated blocks searched by
+ * search_group() and by one search() per block */
+double group_ns_group;
+double group_ns_serial;
+
+void
+group_bench(char *ptr, int size, int rep, char *key, int key_sz, int nblk)
+{
+	perf_t   bm;
+	region_t *res[GROUP_MAX], *r;
+	char     *bufs[GROUP_MAX];
+	int      cnt, g;
+
+	if (nblk > GROUP_MAX)
+		nblk = group = GROUP_MAX;
+	for (g = 0; g < nblk; g++)
+		bufs[g] = kill_cache(ptr);
+	search_group(bufs, nblk, size, key, key_sz, res);
+	for (g = 0; g < nblk; g++)
+		assert(res[g] == search(bufs[g], size, key, key_sz));
+
+	init_timer(&bm);
+#ifdef SCAN_STATS
+	scan_begin();
+#endif
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		for (g = 0; g < nblk; g++)
+			bufs[g] = kill_cache(ptr);
+		search_group(bufs, nblk, size, key, key_sz, res);
+	}
+	stop_timer(&bm);
+#ifdef SCAN_STATS
+	scan_end(&scan_group, (uint64_t)rep * nblk);
+#endif
+	group_ns_group = usec_timer(&bm) * 1e3 / ((double)rep * nblk);
+
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		for (g = 0; g < nblk; g++) {
+			r = search(kill_cache(ptr), size, key, key_sz);
+			assert(r || 1);
+		}
+	}
+	stop_timer(&bm);
+	group_ns_serial = usec_timer(&bm) * 1e3 / ((double)rep * nblk);
+}
+
+#ifndef MPPA
+/* ns per search of the block written to a block file and searched in
+ * the mapping: warm, from the page cache, and cold, where the page
+ * cache of the file is dropped and the file mapped again before each
+ * search.  The cold time includes the page faults and reads. */
+double file_warm_ns;
+double file_cold_ns;
+double file_cold_resident; /* part of the file cached before cold scans */
+
+void
+file_bench(char *ptr, int size, int rep, char *key, int key_sz)
+{
+	blkmap_t    m;
+	recidx_t    saved = blkidx, *saved_copies = cache_ri;
+	search_fn_t fn = keyidx ? search_keyidx : search;
+	region_t    *r, *expect;
+	perf_t      bm;
+	unsigned char *vec;
+	uint64_t    pages, resident, i;
+	int         cnt;
+
+	write_blkfile(blkfile, ptr, size, keyidx ? &blkidx : NULL);
+	expect = search(ptr, size, key, key_sz);
+	m.fd = open(blkfile, O_RDONLY);
+	if (m.fd < 0) {
+		perror(blkfile);
+		exit(1);
+	}
+
+	if (!map_blkfile(&m, blkfile_advice, blkfile_huge)) {
+		printf("bad block file %s\n", blkfile);
+		exit(1);
+	}
+	blkidx = m.ri;
+	cache_ri = NULL;
+	r = fn(m.blk, m.blk_sz, key, key_sz);
+	assert((!r && !expect) || (char *)r - m.blk == (char *)expect - ptr);
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		r = fn(m.blk, m.blk_sz, key, key_sz);
+		assert(r || 1);
+	}
+	stop_timer(&bm);
+	file_warm_ns = usec_timer(&bm) * 1e3 / rep;
+	unmap_blkfile(&m);
+
+	pages = (m.map_sz + getpagesize() - 1) / getpagesize();
+	vec = malloc(pages);
+	assert(vec);
+	file_cold_ns = 0;
+	resident = 0;
+	for (cnt = 0; cnt < blkfile_cold; cnt++) {
+		posix_fadvise(m.fd, 0, 0, POSIX_FADV_DONTNEED);
+		if (!map_blkfile(&m, blkfile_advice, blkfile_huge)) {
+			printf("bad block file %s\n", blkfile);
+			exit(1);
+		}
+		if (mincore(m.map, m.map_sz, vec) == 0) {
+			for (i = 0; i < pages; i++)
+				resident += vec[i] & 1;
+		}
+		blkidx = m.ri;
+		init_timer(&bm);
+		start_timer(&bm);
+		r = fn(m.blk, m.blk_sz, key, key_sz);
+		assert(r || 1);
+		stop_timer(&bm);
+		file_cold_ns += usec_timer(&bm) * 1e3;
+		unmap_blkfile(&m);
+	}
+	if (blkfile_cold) {
+		file_cold_ns /= blkfile_cold;
+		file_cold_resident = (double)resident / pages / blkfile_cold;
+	}
+	free(vec);
+	close(m.fd);
+	blkidx = saved;
+	cache_ri = saved_copies;
+}
+#endif /* !MPPA */
+
+#ifndef MPPA
+/* Streaming search.
+ * The block of a block file is searched without holding it in memory.
+ * It is read in chunks of stream_chunk KB into two buffers by POSIX
+ * AIO, the next chunk being read while the current one is scanned.
+ * The header and compared key bytes of a record that straddles two
+ * chunks are carried to the front of the next buffer, and a value that
+ * runs over is skipped in the following chunks.  Offsets and sizes are
+ * 64-bit so the block can be larger than memory and than 2 GB; the
+ * in-memory modes, which take an int block size, stay below 2 GB.  The
+ * same scan is also timed with synchronous reads, without overlap. */
+#include <aio.h>
+#include <errno.h>
+
+#define STREAM_ALIGN	4096	/* O_DIRECT buffer and length alignment */
+
+char *stream_path;          /* block file, NULL for no streaming */
+int  stream_mb;             /* write a block of this many MB there first */
+int  stream_chunk = 4096;   /* KB */
+int  stream_direct;         /* read with O_DIRECT */
+int  stream_pass = 1;
+
+typedef struct {
+	char         *mem;
+	char         *data;     /* chunk, after the carry area of mem */
+	struct aiocb cb;
+	int          busy;
+	ssize_t      ret;       /* result of a synchronous read */
+} sbuf_t;
+
+typedef struct {
+	uint64_t blk_sz;
+	uint64_t skip;          /* value bytes left to skip */
+	uint64_t found;         /* block offset of the match, or UINT64_MAX */
+	uint64_t bytes;         /* bytes read */
+	char     *tail;         /* unscanned end of the chunk */
+	int      tail_len;
+	int      done;          /* past the last record search() visits */
+} sstate_t;
+
+static void
+stream_submit(sbuf_t *b, int fd, uint64_t off, int len, int async)
+{
+	memset(&b->cb, 0, sizeof(b->cb));
+	b->cb.aio_fildes = fd;
+	b->cb.aio_buf = b->data;
+	/* len is a whole number of pages but for the last chunk, the
+	 * buffers hold the rounded up length */
+	b->cb.aio_nbytes = (len + STREAM_ALIGN - 1) & ~(STREAM_ALIGN - 1);
+	b->cb.aio_offset = off;
+	b->busy = 1;
+	if (!async) {
+		b->ret = pread(fd, b->data, b->cb.aio_nbytes, off);
+		b->busy = 2;
+		return;
+	}
+	if (aio_read(&b->cb)) {
+		perror("aio_read");
+		exit(1);
+	}
+}
+
+static ssize_t
+stream_wait(sbuf_t *b)
+{
+	const struct aiocb *list[1] = { &b->cb };
+
+	if (b->busy == 2) {
+		b->busy = 0;
+		return b->ret;
+	}
+	while (aio_error(&b->cb) == EINPROGRESS)
+		aio_suspend(list, 1, NULL);
+	b->busy = 0;
+	return aio_return(&b->cb);
+}
+
+static void
+stream_cancel(sbuf_t *b)
+{
+	if (b->busy == 1 && aio_cancel(b->cb.aio_fildes, &b->cb) != AIO_ALLDONE)
+		stream_wait(b);
+	else if (b->busy)
+		stream_wait(b);
+}
+
+/* Scan [s, e), the carried tail and the chunk, base is the block
+ * offset of s.  Return 1 when the key is found. */
+static int
+stream_scan_chunk(sstate_t *st, char *s, char *e, uint64_t base, char *key,
+		  int key_sz)
+{
+	region_t *tuple;
+	uint64_t len, roff;
+	char     *p = s;
+	int      cmpsz;
+
+	if (st->skip) {
+		len = st->skip < (uint64_t)(e - p) ? st->skip : (uint64_t)(e - p);
+		p += len;
+		st->skip -= len;
+	}
+	while (!st->skip) {
+		roff = base + (p - s);
+		/* the bound of search() */
+		if (roff + 8 + key_sz >= st->blk_sz) {
+			st->done = 1;
+			break;
+		}
+		if (e - p < 8)
+			break;
+		tuple = (region_t *)p;
+		cmpsz = key_sz;
+		if (tuple->key_sz < cmpsz) {
+			cmpsz = tuple->key_sz;
+		}
+		if (e - p < 8 + cmpsz)
+			break;
+		if (memcmp(tuple->key, key, cmpsz) == 0) {
+			st->found = roff;
+			return 1;
+		}
+		len = 8 + (uint64_t)tuple->key_sz + tuple->val_sz;
+		if (len > (uint64_t)(e - p)) {
+			st->skip = len - (e - p);
+			p = e;
+			break;
+		}
+		p += len;
+	}
+	st->tail = p;
+	st->tail_len = e - p;
+	return 0;
+}
+
+/* Search key in the blk_sz bytes at blk_off of fd, return the block
+ * offset of the record found or UINT64_MAX */
+uint64_t
+stream_search(int fd, uint64_t blk_off, uint64_t blk_sz, char *key,
+	      int key_sz, int async, uint64_t *bytes)
+{
+	sbuf_t   b[2], *cur, *nxt;
+	sstate_t st;
+	uint64_t chunk = (uint64_t)stream_chunk * 1024, nchunk, k, valid;
+	ssize_t  n;
+	int      carry_sz, carry, i;
+
+	carry_sz = (8 + key_sz + STREAM_ALIGN - 1) & ~(STREAM_ALIGN - 1);
+	for (i = 0; i < 2; i++) {
+		if (posix_memalign((void **)&b[i].mem, STREAM_ALIGN,
+				   carry_sz + chunk)) {
+			printf("Out of mem!\n");
+			exit(1);
+		}
+		b[i].data = b[i].mem + carry_sz;
+		b[i].busy = 0;
+	}
+	memset(&st, 0, sizeof(st));
+	st.blk_sz = blk_sz;
+	st.found = UINT64_MAX;
+	nchunk = (blk_sz + chunk - 1) / chunk;
+	for (k = 0; k < 2 && k < nchunk; k++)
+		stream_submit(&b[k], fd, blk_off + k * chunk, chunk, async);
+	carry = 0;
+	for (k = 0; k < nchunk; k++) {
+		cur = &b[k & 1];
+		nxt = &b[(k + 1) & 1];
+		n = stream_wait(cur);
+		valid = blk_sz - k * chunk < chunk ? blk_sz - k * chunk : chunk;
+		if (n < 0 || (uint64_t)n < valid) {
+			printf("short read of %s at %llu\n", stream_path,
+			       (unsigned long long)(blk_off + k * chunk));
+			exit(1);
+		}
+		st.bytes += valid;
+		if (stream_scan_chunk(&st, cur->data - carry, cur->data + valid,
+				      k * chunk - carry, key, key_sz) || st.done)
+			break;
+		assert(st.tail_len <= carry_sz);
+		memcpy(nxt->data - st.tail_len, st.tail, st.tail_len);
+		carry = st.tail_len;
+		if (k + 2 < nchunk)
+			stream_submit(cur, fd, blk_off + (k + 2) * chunk, chunk,
+				      async);
+	}
+	for (i = 0; i < 2; i++) {
+		stream_cancel(&b[i]);
+		free(b[i].mem);
+	}
+	*bytes = st.bytes;
+	return st.found;
+}
+
+/* Write a block file with a block of size bytes of the make_buf()
+ * shape, built in pieces so that it does not need to fit in memory */
+void
+write_stream_blkfile(const char *path, uint64_t size, char *target_key,
+		     int key_sz, int val_sz)
+{
+	blkfile_hdr_t hdr;
+	region_t      *tuple;
+	uint64_t      off, rec_sz = 8 + (uint64_t)key_sz + val_sz;
+	uint64_t      nrec, cnt, stage_sz, fill, len;
+	char          *stage, *rec;
+	int           fd;
+
+	nrec = 0;
+	if (size > 8 + (uint64_t)key_sz)
+		nrec = (size - 8 - key_sz - 1) / rec_sz + 1;
+	rec = calloc(1, rec_sz);
+	stage_sz = 16 << 20;
+	stage = malloc(stage_sz);
+	assert(rec && stage);
+	tuple = (region_t *)rec;
+	tuple->key_sz = key_sz;
+	tuple->val_sz = val_sz;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = BLKFILE_MAGIC;
+	hdr.version = BLKFILE_VERSION;
+	hdr.blk_off = BLKFILE_HDR_SZ;
+	hdr.blk_sz = size;
+	hdr.file_sz = hdr.blk_off + size;
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0) {
+		perror(path);
+		exit(1);
+	}
+	write_all(fd, &hdr, sizeof(hdr), 0);
+	off = 0;
+	fill = 0;
+	for (cnt = 0; cnt < nrec; cnt++) {
+		memcpy(tuple->key, target_key, key_sz);
+		if (cnt != nrec - 1)
+			tuple->key[key_sz - 1]--;
+		len = rec_sz < size - off ? rec_sz : size - off;
+		if (fill + len > stage_sz) {
+			write_all(fd, stage, fill, hdr.blk_off + off - fill);
+			fill = 0;
+		}
+		/* values bigger than the staging area go straight out */
+		if (len > stage_sz) {
+			write_all(fd, rec, len, hdr.blk_off + off);
+		} else {
+			memcpy(stage + fill, rec, len);
+			fill += len;
+		}
+		off += len;
+	}
+	write_all(fd, stage, fill, hdr.blk_off + off - fill);
+	if (ftruncate(fd, hdr.file_sz) || fsync(fd)) {
+		perror(path);
+		exit(1);
+	}
+	close(fd);
+	free(stage);
+	free(rec);
+}
+
+/* MB/s of the streaming search of the block file, with AIO double
+ * buffering and with synchronous reads, from a cold page cache */
+double   stream_mbps;
+double   stream_sync_mbps;
+uint64_t stream_blk_sz;
+int64_t  stream_found;      /* block offset of the match, -1 if none */
+
+void
+stream_bench(char *key, int key_sz, int val_sz)
+{
+	blkfile_hdr_t hdr;
+	perf_t        bm;
+	uint64_t      found, bytes, total;
+	double        usec;
+	int           fd, pass, async;
+
+	/* reads are whole pages, for O_DIRECT and for the buffers */
+	assert(stream_chunk > 0);
+	stream_chunk = (stream_chunk + STREAM_ALIGN / 1024 - 1) &
+		~(STREAM_ALIGN / 1024 - 1);
+	if (stream_mb > 0)
+		write_stream_blkfile(stream_path, (uint64_t)stream_mb << 20, key,
+				     key_sz, val_sz);
+	fd = open(stream_path, O_RDONLY | (stream_direct ? O_DIRECT : 0));
+	if (fd < 0) {
+		perror(stream_path);
+		exit(1);
+	}
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    hdr.magic != BLKFILE_MAGIC || hdr.version != BLKFILE_VERSION) {
+		/* O_DIRECT wants an aligned buffer, try again buffered */
+		int bfd = open(stream_path, O_RDONLY);
+
+		if (bfd < 0 || pread(bfd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+		    hdr.magic != BLKFILE_MAGIC || hdr.version != BLKFILE_VERSION) {
+			printf("bad block file %s\n", stream_path);
+			exit(1);
+		}
+		close(bfd);
+	}
+	if (stream_direct && hdr.blk_off % STREAM_ALIGN) {
+		printf("block of %s is not %d-byte aligned for direct=1\n",
+		       stream_path, STREAM_ALIGN);
+		exit(1);
+	}
+	stream_blk_sz = hdr.blk_sz;
+	for (async = 1; async >= 0; async--) {
+		usec = 0;
+		total = 0;
+		found = UINT64_MAX;
+		for (pass = 0; pass < stream_pass; pass++) {
+			if (!stream_direct)
+				posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+			init_timer(&bm);
+			start_timer(&bm);
+			found = stream_search(fd, hdr.blk_off, hdr.blk_sz, key, key_sz,
+					      async, &bytes);
+			stop_timer(&bm);
+			usec += usec_timer(&bm);
+			total += bytes;
+		}
+		*(async ? &stream_mbps : &stream_sync_mbps) =
+			usec > 0 ? total / usec : 0;
+		stream_found = found == UINT64_MAX ? -1 : (int64_t)found;
+	}
+	close(fd);
+}
+#endif /* !MPPA */
+
+#ifndef MPPA
+/* io_uring multi-block engine.
+ * A lookup searches a set of block files: reads of up to uring_qd
+ * blocks are in flight at once into buffers registered with the ring,
+ * each block is scanned by search() as soon as its read completes, and
+ * once the key is found the reads still in flight are cancelled.  The
+ * ring is driven by the raw system calls, liburing is not needed. */
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+
+#define URING_CANCEL	(~0ULL)		/* user_data of cancel requests */
+
+char *uring_dir;            /* directory of the block set, NULL for none */
+int  uring_nblk = 16;       /* blocks per lookup */
+int  uring_qd = 8;          /* reads in flight */
+
+typedef struct {
+	int                 fd;
+	unsigned            entries;
+	unsigned           *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned           *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void               *sq_map, *cq_map;
+	size_t              sq_map_sz, cq_map_sz, sqes_sz;
+	unsigned            to_submit;
+} uring_t;
+
+static int
+uring_init(uring_t *u, unsigned entries)
+{
+	struct io_uring_params p;
+
+	memset(u, 0, sizeof(*u));
+	memset(&p, 0, sizeof(p));
+	u->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (u->fd < 0)
+		return -1;
+	u->entries = p.sq_entries;
+	u->sq_map_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	u->cq_map_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_map_sz > u->sq_map_sz)
+			u->sq_map_sz = u->cq_map_sz;
+		u->cq_map_sz = u->sq_map_sz;
+	}
+	u->sq_map = mmap(NULL, u->sq_map_sz, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	u->cq_map = u->sq_map;
+	if (u->sq_map != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP))
+		u->cq_map = mmap(NULL, u->cq_map_sz, PROT_READ | PROT_WRITE,
+				 MAP_SHARED | MAP_POPULATE, u->fd,
+				 IORING_OFF_CQ_RING);
+	u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->sq_map == MAP_FAILED || u->cq_map == MAP_FAILED ||
+	    u->sqes == MAP_FAILED) {
+		close(u->fd);
+		return -1;
+	}
+	u->sq_head = (unsigned *)((char *)u->sq_map + p.sq_off.head);
+	u->sq_tail = (unsigned *)((char *)u->sq_map + p.sq_off.tail);
+	u->sq_mask = (unsigned *)((char *)u->sq_map + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)((char *)u->sq_map + p.sq_off.array);
+	u->cq_head = (unsigned *)((char *)u->cq_map + p.cq_off.head);
+	u->cq_tail = (unsigned *)((char *)u->cq_map + p.cq_off.tail);
+	u->cq_mask = (unsigned *)((char *)u->cq_map + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)((char *)u->cq_map + p.cq_off.cqes);
+	return 0;
+}
+
+static void
+uring_exit(uring_t *u)
+{
+	munmap(u->sqes, u->sqes_sz);
+	if (u->cq_map != u->sq_map)
+		munmap(u->cq_map, u->cq_map_sz);
+	munmap(u->sq_map, u->sq_map_sz);
+	close(u->fd);
+}
+
+/* Next free submission entry, zeroed */
+static struct io_uring_sqe *
+uring_sqe(uring_t *u)
+{
+	unsigned tail = *u->sq_tail + u->to_submit;
+	struct io_uring_sqe *sqe;
+
+	if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) >= u->entries)
+		return NULL;
+	sqe = &u->sqes[tail & *u->sq_mask];
+	memset(sqe, 0, sizeof(*sqe));
+	u->sq_array[tail & *u->sq_mask] = tail & *u->sq_mask;
+	u->to_submit++;
+	return sqe;
+}
+
+/* Submit the prepared entries and wait for wait_nr completions */
+static int
+uring_enter(uring_t *u, unsigned wait_nr)
+{
+	int ret;
+
+	__atomic_store_n(u->sq_tail, *u->sq_tail + u->to_submit,
+			 __ATOMIC_RELEASE);
+	do {
+		ret = syscall(__NR_io_uring_enter, u->fd, u->to_submit, wait_nr,
+			      wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+	if (ret >= 0)
+		u->to_submit -= ret < (int)u->to_submit ? ret : u->to_submit;
+	return ret;
+}
+
+static struct io_uring_cqe *
+uring_cqe(uring_t *u)
+{
+	unsigned head = *u->cq_head;
+
+	if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &u->cqes[head & *u->cq_mask];
+}
+
+static void
+uring_cqe_seen(uring_t *u)
+{
+	__atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/* The block set: one block file per block, the registered buffers
+ * and the ring */
+typedef struct {
+	uring_t   ring;
+	int       nblk, qd;
+	int      *fds;
+	uint64_t  blk_off;
+	uint64_t  blk_sz;
+	uint64_t  read_sz;     /* blk_sz rounded up for O_DIRECT */
+	char     *bufs;        /* qd buffers of read_sz bytes */
+	uint64_t *slot_data;   /* user_data of the read in each slot, 0 when
+				* idle or cancelled */
+} blkset_t;
+
+static int
+blkset_open(blkset_t *bs, int nblk, int qd, uint64_t blk_sz)
+{
+	struct iovec *iov;
+	char         path[4096];
+	int          i;
+
+	bs->nblk = nblk;
+	bs->qd = qd;
+	bs->blk_off = BLKFILE_HDR_SZ;
+	bs->blk_sz = blk_sz;
+	bs->read_sz = (blk_sz + STREAM_ALIGN - 1) & ~(STREAM_ALIGN - 1);
+	bs->fds = malloc(nblk * sizeof(*bs->fds));
+	bs->slot_data = calloc(qd, sizeof(*bs->slot_data));
+	iov = malloc(qd * sizeof(*iov));
+	assert(bs->fds && bs->slot_data && iov);
+	for (i = 0; i < nblk; i++) {
+		snprintf(path, sizeof(path), "%s/blk-%04d.sblk", uring_dir, i);
+		bs->fds[i] = open(path, O_RDONLY |
+				  (stream_direct ? O_DIRECT : 0));
+		if (bs->fds[i] < 0) {
+			perror(path);
+			exit(1);
+		}
+	}
+	if (posix_memalign((void **)&bs->bufs, STREAM_ALIGN,
+			   (size_t)bs->read_sz * qd)) {
+		printf("Out of mem!\n");
+		exit(1);
+	}
+	for (i = 0; i < qd; i++) {
+		iov[i].iov_base = bs->bufs + (size_t)bs->read_sz * i;
+		iov[i].iov_len = bs->read_sz;
+	}
+	if (uring_init(&bs->ring, 2 * qd) < 0) {
+		perror("io_uring_setup");
+		free(iov);
+		return -1;
+	}
+	if (syscall(__NR_io_uring_register, bs->ring.fd,
+		    IORING_REGISTER_BUFFERS, iov, qd) < 0 ||
+	    syscall(__NR_io_uring_register, bs->ring.fd,
+		    IORING_REGISTER_FILES, bs->fds, nblk) < 0) {
+		perror("io_uring_register");
+		uring_exit(&bs->ring);
+		free(iov);
+		return -1;
+	}
+	free(iov);
+	return 0;
+}
+
+static void
+blkset_close(blkset_t *bs, int ring)
+{
+	int i;
+
+	if (ring)
+		uring_exit(&bs->ring);
+	for (i = 0; i < bs->nblk; i++)
+		close(bs->fds[i]);
+	free(bs->fds);
+	free(bs->slot_data);
+	free(bs->bufs);
+}
+
+/* Search key in the blocks of the set, return the block it is in or
+ * -1.  nread gets the number of blocks scanned. */
+int
+uring_search(blkset_t *bs, char *key, int key_sz, int *nread)
+{
+	uring_t             *u = &bs->ring;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	uint64_t            data;
+	char                *buf;
+	int                 next = 0, inflight = 0, found = -1, cancels = 0;
+	int                 slot, blk, i;
+	uint64_t            free_slots = ~0ULL >> (64 - bs->qd);
+
+	*nread = 0;
+	while (inflight || cancels || (found < 0 && next < bs->nblk)) {
+		while (found < 0 && next < bs->nblk && free_slots) {
+			slot = __builtin_ctzll(free_slots);
+			sqe = uring_sqe(u);
+			assert(sqe);
+			free_slots &= ~(1ULL << slot);
+			sqe->opcode = IORING_OP_READ_FIXED;
+			sqe->flags = IOSQE_FIXED_FILE;
+			sqe->fd = next;
+			sqe->addr = (uint64_t)(uintptr_t)(bs->bufs +
+							  (size_t)bs->read_sz * slot);
+			sqe->len = bs->read_sz;
+			sqe->off = bs->blk_off;
+			sqe->buf_index = slot;
+			/* block + 1, never 0 */
+			sqe->user_data = bs->slot_data[slot] =
+				((uint64_t)(next + 1) << 8) | slot;
+			next++;
+			inflight++;
+		}
+		if (uring_enter(u, 1) < 0) {
+			perror("io_uring_enter");
+			exit(1);
+		}
+		while ((cqe = uring_cqe(u))) {
+			data = cqe->user_data;
+			if (data == URING_CANCEL) {
+				cancels--;
+				uring_cqe_seen(u);
+				continue;
+			}
+			slot = data & 0xff;
+			blk = (data >> 8) - 1;
+			inflight--;
+			free_slots |= 1ULL << slot;
+			bs->slot_data[slot] = 0;
+			if (found < 0 && cqe->res != -ECANCELED) {
+				if (cqe->res < 0 ||
+				    (uint64_t)cqe->res < bs->blk_sz) {
+					printf("read of block %d failed: %d\n", blk,
+					       cqe->res);
+					exit(1);
+				}
+				buf = bs->bufs + (size_t)bs->read_sz * slot;
+				(*nread)++;
+				if (search(buf, bs->blk_sz, key, key_sz))
+					found = blk;
+			}
+			uring_cqe_seen(u);
+			if (found < 0 || !inflight)
+				continue;
+			/* cancel the reads still in flight, once */
+			for (i = 0; i < bs->qd; i++) {
+				if (!bs->slot_data[i] || (free_slots >> i) & 1)
+					continue;
+				sqe = uring_sqe(u);
+				if (!sqe)
+					break;
+				sqe->opcode = IORING_OP_ASYNC_CANCEL;
+				sqe->addr = bs->slot_data[i];
+				sqe->user_data = URING_CANCEL;
+				bs->slot_data[i] = 0;
+				cancels++;
+			}
+		}
+	}
+	return found;
+}
+
+/* Same search with one pread() at a time, in block order */
+int
+sync_search(blkset_t *bs, char *key, int key_sz, int *nread)
+{
+	int blk;
+
+	for (blk = 0; blk < bs->nblk; blk++) {
+		if (pread(bs->fds[blk], bs->bufs, bs->read_sz, bs->blk_off) <
+		    (ssize_t)bs->blk_sz) {
+			printf("read of block %d failed\n", blk);
+			exit(1);
+		}
+		*nread = blk + 1;
+		if (search(bs->bufs, bs->blk_sz, key, key_sz))
+			return blk;
+	}
+	return -1;
+}
+
+/* Key of block blk of the set: the target key with the block number in
+ * its first 4 bytes */
+static void
+uring_key(char *key, char *target, int key_sz, int blk)
+{
+	memcpy(key, target, key_sz);
+	key[0] = blk >> 24;
+	key[1] = blk >> 16;
+	key[2] = blk >> 8;
+	key[3] = blk;
+}
+
+/* Lookups per second of rep lookups of the block set, each for the key
+ * of a random block, with the io_uring engine and with preads */
+double uring_lps;
+double uring_sync_lps;
+double uring_blocks;        /* blocks scanned per lookup */
+double uring_sync_blocks;
+
+void
+uring_bench(int size, int rep, char *target, int key_sz, int val_sz)
+{
+	blkset_t bs;
+	perf_t   bm;
+	char     *buf, *key, path[4096];
+	int      bycmp, nread, cnt, blk, ring, total;
+
+	if (key_sz < 5) {
+		printf("uring mode needs keys of 5 bytes or more\n");
+		exit(1);
+	}
+	buf = malloc(size + 8 + key_sz + val_sz);
+	key = malloc(key_sz);
+	assert(buf && key);
+	if (mkdir(uring_dir, 0755) && errno != EEXIST) {
+		perror(uring_dir);
+		exit(1);
+	}
+	for (blk = 0; blk < uring_nblk; blk++) {
+		uring_key(key, target, key_sz, blk);
+		make_buf(buf, size, key, key_sz, val_sz, &bycmp, NULL);
+		snprintf(path, sizeof(path), "%s/blk-%04d.sblk", uring_dir, blk);
+		write_blkfile(path, buf, size, NULL);
+	}
+	free(buf);
+
+	if (uring_qd > 64)
+		uring_qd = 64;
+	if (uring_qd < 1)
+		uring_qd = 1;
+	ring = blkset_open(&bs, uring_nblk, uring_qd, size) == 0;
+	uring_lps = uring_blocks = -1;
+	for (cnt = 0; ring && cnt < uring_nblk; cnt++) {
+		uring_key(key, target, key_sz, cnt);
+		blk = uring_search(&bs, key, key_sz, &nread);
+		assert(blk == cnt);
+		assert(sync_search(&bs, key, key_sz, &nread) == cnt);
+	}
+	srand(5);
+	if (ring) {
+		total = 0;
+		init_timer(&bm);
+		start_timer(&bm);
+		for (cnt = 0; cnt < rep; cnt++) {
+			uring_key(key, target, key_sz, rand() % uring_nblk);
+			blk = uring_search(&bs, key, key_sz, &nread);
+			assert(blk >= 0);
+			total += nread;
+		}
+		stop_timer(&bm);
+		uring_lps = rep / (usec_timer(&bm) * 1e-6);
+		uring_blocks = (double)total / rep;
+	}
+	srand(5);
+	total = 0;
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		uring_key(key, target, key_sz, rand() % uring_nblk);
+		blk = sync_search(&bs, key, key_sz, &nread);
+		assert(blk >= 0);
+		total += nread;
+	}
+	stop_timer(&bm);
+	uring_sync_lps = rep / (usec_timer(&bm) * 1e-6);
+	uring_sync_blocks = (double)total / rep;
+	blkset_close(&bs, ring);
+	free(key);
+}
+#endif /* !MPPA */
+
+#ifndef MPPA
+/* Compressed blocks.
+ * A compressed block keeps its records with the key-prefix delta of
+ * LevelDB tables: each record is the number of key bytes it shares with
+ * the previous key, the number of its other key bytes and its value size
+ * as varints, followed by those key bytes and the value.  The bytes after
+ * the last whole record are kept as they are.  The delta encoding is then
+ * compressed as one zlib stream at level zlevel, level 0 keeps the delta
+ * encoding alone.  A lookup rebuilds the region_t block, which search()
+ * scans as usual, into a slot of a CLOCK cache of zcache decompressed
+ * blocks, so that hot blocks are not decompressed again. */
+#include <zlib.h>
+
+#define ZBLK_MAGIC	0x4b4c425a	/* "ZBLK" */
+
+int compress_blk;           /* run the compressed block benchmark */
+int zblocks = 64;           /* blocks of the compressed set */
+int zlevel = 6;             /* zlib level, 0 for the delta encoding only */
+int zdelta = 1;             /* key-prefix delta encoding of the records */
+int zcache = 16;            /* decompressed blocks cached, 0 for none */
+int zbits = 4;              /* random bits per value byte */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t level;
+	uint32_t delta;
+	uint32_t nrec;       /* delta encoded records */
+	uint32_t raw_sz;     /* size of the region_t block */
+	uint32_t delta_sz;   /* size of the delta encoding */
+	uint32_t comp_sz;    /* bytes following the header */
+	uint32_t pad;
+} zblk_hdr_t;
+
+/* Largest delta encoding of a block of size bytes: records of 8 bytes
+ * or more, each with up to 15 varint bytes instead of its 8 byte header */
+static size_t
+zblk_delta_bound(int size)
+{
+	return (size_t)size + (size_t)size / 8 * 7 + 16;
+}
+
+/* Largest compressed block of a block of size bytes */
+size_t
+zblk_bound(int size)
+{
+	return sizeof(zblk_hdr_t) + compressBound(zblk_delta_bound(size));
+}
+
+static uint32_t
+zblk_encode(uint8_t *dst, char *buf, int size, int delta, uint32_t *nrec)
+{
+	region_t *tuple;
+	char     *curr = buf, *prev = NULL;
+	uint8_t  *p = dst;
+	uint32_t shared, prev_sz = 0;
+
+	for (*nrec = 0; curr + 8 <= buf + size; (*nrec)++) {
+		tuple = (region_t *)curr;
+		if ((uint64_t)tuple->key_sz + tuple->val_sz >
+		    (uint64_t)(buf + size - curr - 8))
+			break;
+		shared = 0;
+		while (delta && shared < tuple->key_sz && shared < prev_sz &&
+		       tuple->key[shared] == prev[shared])
+			shared++;
+		p = varint_put(p, shared);
+		p = varint_put(p, tuple->key_sz - shared);
+		p = varint_put(p, tuple->val_sz);
+		memcpy(p, tuple->key + shared,
+		       tuple->key_sz - shared + tuple->val_sz);
+		p += tuple->key_sz - shared + tuple->val_sz;
+		prev = tuple->key;
+		prev_sz = tuple->key_sz;
+		curr = tuple->key + tuple->key_sz + tuple->val_sz;
+	}
+	memcpy(p, curr, buf + size - curr);
+	p += buf + size - curr;
+	return p - dst;
+}
+
+static void
+zblk_decode(char *dst, const uint8_t *src, zblk_hdr_t *h)
+{
+	const uint8_t *p = src;
+	region_t      *tuple;
+	char          *curr = dst, *prev = NULL;
+	uint32_t      shared, rest, cnt;
+
+	for (cnt = 0; cnt < h->nrec; cnt++) {
+		tuple = (region_t *)curr;
+		p = varint_get(p, &shared);
+		p = varint_get(p, &rest);
+		p = varint_get(p, &tuple->val_sz);
+		tuple->key_sz = shared + rest;
+		memcpy(tuple->key, prev, shared);
+		memcpy(tuple->key + shared, p, rest + tuple->val_sz);
+		p += rest + tuple->val_sz;
+		prev = tuple->key;
+		curr = tuple->key + tuple->key_sz + tuple->val_sz;
+	}
+	memcpy(curr, p, dst + h->raw_sz - curr);
+	assert(p + (dst + h->raw_sz - curr) == src + h->delta_sz);
+}
+
+/* Compress the size bytes block at buf into dst, which has room for
+ * zblk_bound(size) bytes.  Return the size of the compressed block. */
+size_t
+build_zblk(char *dst, char *buf, int size, int level, int delta)
+{
+	zblk_hdr_t *h = (zblk_hdr_t *)dst;
+	uint8_t    *tmp;
+	uLongf     len;
+
+	tmp = malloc(zblk_delta_bound(size));
+	assert(tmp);
+	memset(h, 0, sizeof(*h));
+	h->magic = ZBLK_MAGIC;
+	h->level = level;
+	h->delta = delta;
+	h->raw_sz = size;
+	h->delta_sz = zblk_encode(tmp, buf, size, delta, &h->nrec);
+	assert(h->delta_sz <= zblk_delta_bound(size));
+	if (level == 0) {
+		memcpy(h + 1, tmp, h->delta_sz);
+		h->comp_sz = h->delta_sz;
+	} else {
+		len = compressBound(h->delta_sz);
+		if (compress2((Bytef *)(h + 1), &len, tmp, h->delta_sz,
+			      level) != Z_OK) {
+			printf("compression of a block failed\n");
+			exit(1);
+		}
+		h->comp_sz = len;
+	}
+	free(tmp);
+	return sizeof(*h) + h->comp_sz;
+}
+
+/* Rebuild in dst the region_t block of the compressed block at src, tmp
+ * has room for its delta encoding */
+void
+unpack_zblk(char *dst, char *src, uint8_t *tmp)
+{
+	zblk_hdr_t    *h = (zblk_hdr_t *)src;
+	const uint8_t *delta = (const uint8_t *)(h + 1);
+	uLongf        len = h->delta_sz;
+
+	assert(h->magic == ZBLK_MAGIC);
+	if (h->level) {
+		if (uncompress(tmp, &len, delta, h->comp_sz) != Z_OK ||
+		    len != h->delta_sz) {
+			printf("corrupt compressed block\n");
+			exit(1);
+		}
+		delta = tmp;
+	}
+	zblk_decode(dst, delta, h);
+}
+
+/* CLOCK cache of decompressed blocks */
+typedef struct {
+	int       nslot;
+	int       hand;
+	char    **slot_buf;
+	int      *slot_blk;  /* block in each slot, -1 for a free slot */
+	uint8_t  *ref;       /* reference bit of each slot */
+	int      *blk_slot;  /* slot of each block, -1 if not cached */
+	uint8_t  *tmp;
+	uint64_t  hits;
+	uint64_t  misses;
+} zcache_t;
+
+void
+zcache_init(zcache_t *zc, int nslot, int nblk, int size)
+{
+	int cnt, n = nslot ? nslot : 1;
+
+	memset(zc, 0, sizeof(*zc));
+	zc->nslot = nslot;
+	zc->slot_buf = malloc(n * sizeof(*zc->slot_buf));
+	zc->slot_blk = malloc(n * sizeof(*zc->slot_blk));
+	zc->ref = calloc(n, 1);
+	zc->blk_slot = malloc(nblk * sizeof(*zc->blk_slot));
+	zc->tmp = malloc(zblk_delta_bound(size));
+	assert(zc->slot_buf && zc->slot_blk && zc->ref && zc->blk_slot &&
+	       zc->tmp);
+	for (cnt = 0; cnt < n; cnt++) {
+		zc->slot_buf[cnt] = bench_alloc(size);
+		assert(zc->slot_buf[cnt]);
+		zc->slot_blk[cnt] = -1;
+	}
+	for (cnt = 0; cnt < nblk; cnt++)
+		zc->blk_slot[cnt] = -1;
+}
+
+void
+zcache_free(zcache_t *zc, int size)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < (zc->nslot ? zc->nslot : 1); cnt++)
+		bench_free(zc->slot_buf[cnt], size);
+	free(zc->slot_buf);
+	free(zc->slot_blk);
+	free(zc->ref);
+	free(zc->blk_slot);
+	free(zc->tmp);
+}
+
+/* Return block blk of the compressed blocks zb[] decompressed */
+char *
+zcache_get(zcache_t *zc, char **zb, int blk)
+{
+	int s = zc->blk_slot[blk];
+
+	if (s >= 0) {
+		zc->ref[s] = 1;
+		zc->hits++;
+		return zc->slot_buf[s];
+	}
+	zc->misses++;
+	if (zc->nslot == 0) {
+		unpack_zblk(zc->slot_buf[0], zb[blk], zc->tmp);
+		return zc->slot_buf[0];
+	}
+	/* the hand gives referenced slots a second chance */
+	while (zc->ref[zc->hand]) {
+		zc->ref[zc->hand] = 0;
+		zc->hand = (zc->hand + 1) % zc->nslot;
+	}
+	s = zc->hand;
+	zc->hand = (s + 1) % zc->nslot;
+	if (zc->slot_blk[s] >= 0)
+		zc->blk_slot[zc->slot_blk[s]] = -1;
+	unpack_zblk(zc->slot_buf[s], zb[blk], zc->tmp);
+	zc->slot_blk[s] = blk;
+	zc->blk_slot[blk] = s;
+	zc->ref[s] = 1;
+	return zc->slot_buf[s];
+}
+
+/* zblocks blocks of distinct keys with values of zbits random bits per
+ * byte, compressed, and rep lookups of a random key of a random block
+ * through the decompressed-block cache, against search() of the blocks
+ * left uncompressed */
+uint64_t zraw_bytes;
+uint64_t zdelta_bytes;
+uint64_t zcomp_bytes;
+double   zdecomp_ns;        /* ns to rebuild a block */
+double   zlookup_ns;
+double   zraw_ns;
+double   zhit_ratio;
+
+void
+zblk_bench(int size, int rep, char *target, int key_sz, int val_sz)
+{
+	zcache_t zc;
+	perf_t   bm;
+	region_t *tuple, *r;
+	uint32_t **off, *nrec;
+	char     **raw, **zb, **probe, *key, *v;
+	uint8_t  mask;
+	int      *pblk, bycmp, blk, cnt, i, n;
+
+	if (key_sz < 5) {
+		printf("compressed mode needs keys of 5 bytes or more\n");
+		exit(1);
+	}
+	if (zblocks < 1)
+		zblocks = 1;
+	raw = malloc(zblocks * sizeof(*raw));
+	zb = malloc(zblocks * sizeof(*zb));
+	off = malloc(zblocks * sizeof(*off));
+	nrec = malloc(zblocks * sizeof(*nrec));
+	key = malloc(key_sz);
+	assert(raw && zb && off && nrec && key);
+	mask = zbits >= 8 ? 0xff : (1 << zbits) - 1;
+	wl_state = 7;
+	zraw_bytes = zdelta_bytes = zcomp_bytes = 0;
+	for (blk = 0; blk < zblocks; blk++) {
+		raw[blk] = calloc(1, size + 8 + key_sz + val_sz);
+		zb[blk] = malloc(zblk_bound(size));
+		assert(raw[blk] && zb[blk]);
+		uring_key(key, target, key_sz, blk);
+		make_sorted_buf(raw[blk], size, key, key_sz, val_sz, &bycmp);
+		off[blk] = sortidx.ri.off;
+		nrec[blk] = sortidx.ri.nrec;
+		free(sortidx.ikey);
+		free(sortidx.eyt);
+		free(sortidx.eytkey);
+		if (nrec[blk] == 0) {
+			printf("no record fits a block\n");
+			exit(1);
+		}
+		for (cnt = 0; cnt < (int)nrec[blk]; cnt++) {
+			tuple = (region_t *)(raw[blk] + off[blk][cnt]);
+			v = tuple->key + key_sz;
+			wl_fill(v, val_sz);
+			for (i = 0; i < val_sz; i++)
+				v[i] = 'A' + (v[i] & mask);
+		}
+		zcomp_bytes += build_zblk(zb[blk], raw[blk], size, zlevel, zdelta);
+		zdelta_bytes += ((zblk_hdr_t *)zb[blk])->delta_sz;
+		zraw_bytes += size;
+	}
+
+	zcache_init(&zc, zcache, zblocks, size);
+	for (blk = 0; blk < zblocks; blk++) {
+		unpack_zblk(zc.slot_buf[0], zb[blk], zc.tmp);
+		assert(memcmp(zc.slot_buf[0], raw[blk], size) == 0);
+	}
+	/* at least 64 decompressions, cycling over the blocks */
+	n = (64 + zblocks - 1) / zblocks * zblocks;
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < n; cnt++)
+		unpack_zblk(zc.slot_buf[0], zb[cnt % zblocks], zc.tmp);
+	stop_timer(&bm);
+	zdecomp_ns = usec_timer(&bm) * 1e3 / n;
+
+	pblk = malloc(rep * sizeof(*pblk));
+	probe = malloc(rep * sizeof(*probe));
+	assert(pblk && probe);
+	srand(7);
+	for (cnt = 0; cnt < rep; cnt++) {
+		blk = rand() % zblocks;
+		pblk[cnt] = blk;
+		probe[cnt] = ((region_t *)(raw[blk] +
+					   off[blk][rand() % nrec[blk]]))->key;
+	}
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		r = search(zcache_get(&zc, zb, pblk[cnt]), size, probe[cnt],
+			   key_sz);
+		assert(r);
+	}
+	stop_timer(&bm);
+	zlookup_ns = usec_timer(&bm) * 1e3 / rep;
+	zhit_ratio = (double)zc.hits / (zc.hits + zc.misses);
+
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		r = search(raw[pblk[cnt]], size, probe[cnt], key_sz);
+		assert(r);
+	}
+	stop_timer(&bm);
+	zraw_ns = usec_timer(&bm) * 1e3 / rep;
+
+	zcache_free(&zc, size);
+	for (blk = 0; blk < zblocks; blk++) {
+		free(raw[blk]);
+		free(zb[blk]);
+		free(off[blk]);
+	}
+	free(raw);
+	free(zb);
+	free(off);
+	free(nrec);
+	free(pblk);
+	free(probe);
+	free(key);
+}
+#endif /* !MPPA */
+
+void
+search_bench (workload_t *w, int rep, double *usec, int *bycmp)
+{
+	perf_t   bm;
+	char     *ptr, *tmp, *key;
+	region_t *r;
+	search_fn_t search_fn = search;
+	int      size = w->size;
+	int      key_sz, cnt, i;
+	int      nrep = rep;
+
+	init_timer(&bm);
+	ptr = bench_alloc(size + 8 + w->kmax + w->vmax);
+	if(!ptr){
+		printf("Out of mem!\n");
+		exit(1);
+	}
+	if (w->kdist == WL_CLASSIC) {
+		make_buf(ptr, size, w->keys[0], w->key_sz, w->val_sz, bycmp,
+			 &blkidx);
+		fix_cache(ptr, size, *bycmp, 256*1024*1024);
+	} else {
+		wl_make(w, ptr, bycmp);
+		build_recidx(&blkidx, ptr, size, w->min_len, keyidx);
+		for (cnt = 0; cnt < w->nlookup; cnt++) {
+			r = search(ptr, size, w->keys[cnt], w->key_len[cnt]);
+			assert(!r == !w->found[cnt]);
+		}
+		copy_cache(ptr, size, *bycmp, 256*1024*1024);
+	}
+	/* the extra benchmarks below look up the first key */
+	key = w->keys[0];
+	key_sz = w->key_len[0];
+	if (keyidx) {
+		search_fn = search_keyidx;
+#ifndef MPPA
+		if (!dcache)
+			cache_recidx(&blkidx);
+#endif
+	}
+#ifndef MPPA
+	/* the parallel scan only uses the record offsets of the index */
+	if (nthreads > 1) {
+		pool_init(&blkidx, nthreads);
+		nthreads = pool.nthreads;
+		search_fn = search_par;
+	}
+#else
+	nthreads = 1;
+#endif
+	if (filter) {
+		build_filter(&blkfilter, ptr, size, key_sz, filter, filter_bpk);
+		filtered_fn = search_fn;
+		search_fn = search_filtered;
+	}
+	cnt = 0;
+#ifdef SCAN_STATS
+	scan_begin();
+#endif
+	perf_start();
+	start_timer(&bm);
+	while(rep--) {
+		tmp = kill_cache(ptr);
+		r = search_fn(tmp, size, w->keys[cnt], w->key_len[cnt]);
+		assert(r || 1);
+		if (++cnt == w->nlookup)
+			cnt = 0;
+	}
+	stop_timer(&bm);
+	perf_stop();
+	*usec = usec_timer(&bm);
+#ifdef SCAN_STATS
+	scan_end(&scan_stats, nrep);
+#endif
+	if (lat) {
+		uint64_t t0;
+
+		memset(&lat_hist, 0, sizeof(lat_hist));
+		for (cnt = 0; cnt < nrep; cnt++) {
+			i = cnt % w->nlookup;
+			tmp = kill_cache(ptr);
+			t0 = lat_now_ns();
+			r = search_fn(tmp, size, w->keys[i], w->key_len[i]);
+			lat_record(&lat_hist, lat_now_ns() - t0);
+			assert(r || 1);
+		}
+	}
+	if (filter) {
+		filter_bench(ptr, size, nrep, key_sz);
+	}
+	if (batch) {
+		batch_bench(ptr, size, nrep, key, key_sz, batch);
+	}
+	if (group > 0) {
+		group_bench(ptr, size, nrep, key, key_sz, group);
+	}
+#ifndef MPPA
+	if (blkfile) {
+		file_bench(ptr, size, nrep, key, key_sz);
+	}
+#endif
+}
+
+/* Lookups of the sorted block benchmark cycle over SORTED_NPROBE keys
+ * of the block, the last one being the target key */
+#define SORTED_NPROBE 64
+
+const char *sorted_names[SORTED_NSTRAT] = {
+	"linear", "binary", "interp", "eytzinger"
+};
+
+/* Time each strategy of a sorted block, ns[] gets the ns per lookup */
+void
+sorted_bench(int size, int rep, char *key, int key_sz, int val_sz,
+	     double *ns)
+{
+	search_fn_t fn[SORTED_NSTRAT] = {
+		search, search_binary, search_interp, search_eytzinger
+	};
+	region_t *r, *expect[SORTED_NPROBE];
+	char     *ptr, *probe[SORTED_NPROBE];
+	int      bycmp, strat, cnt, i;
+
+	ptr = bench_alloc(size + 8 + key_sz + val_sz);
+	if(!ptr){
+		printf("Out of mem!\n");
+		exit(1);
+	}
+	make_sorted_buf(ptr, size, key, key_sz, val_sz, &bycmp);
+	if (sortidx.ri.nrec == 0) {
+		for (strat = 0; strat < SORTED_NSTRAT; strat++)
+			ns[strat] = 0;
+		return;
+	}
+	copy_cache(ptr, size, bycmp, 256*1024*1024);
+
+	srand(2);
+	for (i = 0; i < SORTED_NPROBE; i++) {
+		cnt = i == SORTED_NPROBE - 1 ? sortidx.ri.nrec - 1 :
+			rand() % sortidx.ri.nrec;
+		probe[i] = ((region_t *)(ptr + sortidx.ri.off[cnt]))->key;
+		expect[i] = search(ptr, size, probe[i], key_sz);
+		assert(expect[i]);
+		for (strat = 1; strat < SORTED_NSTRAT; strat++) {
+			r = fn[strat](ptr, size, probe[i], key_sz);
+			assert(r && memcmp(r->key, probe[i], key_sz) == 0);
+		}
+	}
+
+	for (strat = 0; strat < SORTED_NSTRAT; strat++) {
+		ns[strat] = lookup_ns(fn[strat], ptr, size, probe, SORTED_NPROBE,
+				      key_sz, rep);
+	}
+}
+
+/* Lookup latency of a hashed block against search() of its records,
+ * over SORTED_NPROBE keys of a block of distinct keys, and the bytes
+ * the table adds to the block */
+double   hashed_ns;
+double   hashed_linear_ns;
+uint64_t hashed_table_bytes;
+double   hashed_load;
+
+void
+hashed_bench(int size, int rep, char *key, int key_sz, int val_sz)
+{
+	hashed_hdr_t *h;
+	region_t     *r;
+	char         *blk, *ptr, *probe[SORTED_NPROBE];
+	int          hsize, bycmp, cnt, i;
+
+	blk = malloc(size + 8 + key_sz + val_sz);
+	assert(blk);
+	make_sorted_buf(blk, size, key, key_sz, val_sz, &bycmp);
+	if (sortidx.ri.nrec == 0) {
+		hashed_ns = hashed_linear_ns = 0;
+		free(blk);
+		return;
+	}
+	ptr = bench_alloc(hashed_table_sz(sortidx.ri.nrec) + size + 8 + key_sz +
+			  val_sz);
+	if(!ptr){
+		printf("Out of mem!\n");
+		exit(1);
+	}
+	hsize = build_hashed_block(ptr, blk, size, key_sz);
+	h = (hashed_hdr_t *)ptr;
+	hashed_table_bytes = h->rec_off;
+	hashed_load = (double)h->nrec / (h->ngroups * HASHED_GROUP);
+
+	srand(2);
+	for (i = 0; i < SORTED_NPROBE; i++) {
+		cnt = i == SORTED_NPROBE - 1 ? sortidx.ri.nrec - 1 :
+			rand() % sortidx.ri.nrec;
+		probe[i] = ((region_t *)(ptr + h->rec_off +
+					 sortidx.ri.off[cnt]))->key;
+		r = search_hashed(ptr, hsize, probe[i], key_sz);
+		assert(r == search_hashed_linear(ptr, hsize, probe[i], key_sz));
+		assert(r);
+	}
+	copy_cache(ptr, hsize, bycmp, 256*1024*1024);
+	/* the probes point into ptr, which kill_cache() does not hand out */
+	hashed_ns = lookup_ns(search_hashed, ptr, hsize, probe, SORTED_NPROBE,
+			      key_sz, rep);
+	hashed_linear_ns = lookup_ns(search_hashed_linear, ptr, hsize, probe,
+				     SORTED_NPROBE, key_sz, rep);
+	free(blk);
+}
+
+/* Lookup latency of a front-coded block against search() and the
+ * binary search of the sorted region_t block it was built from, over
+ * SORTED_NPROBE keys of a block of distinct keys, and the bytes and
+ * cache lines each lookup reads */
+int    fc_size;
+double fc_ns;
+double fc_region_ns;
+double fc_binary_ns;
+double fc_bytes, fc_lines;
+double fc_region_bytes, fc_region_lines;
+
+void
+fc_bench(int size, int rep, char *key, int key_sz, int val_sz)
+{
+	perf_t   bm;
+	touch_t  t;
+	region_t *r;
+	uint32_t vsz;
+	uint64_t blk_sz = size + 8 + key_sz + val_sz, fc_sz;
+	char     *blk, *fc, *v, *probe[SORTED_NPROBE];
+	int      bycmp, cnt, i;
+
+	blk = bench_alloc(blk_sz);
+	if(!blk){
+		printf("Out of mem!\n");
+		exit(1);
+	}
+	make_sorted_buf(blk, size, key, key_sz, val_sz, &bycmp);
+	if (sortidx.ri.nrec == 0) {
+		fc_ns = fc_region_ns = fc_binary_ns = 0;
+		bench_free(blk, blk_sz);
+		return;
+	}
+	fc_sz = fc_bound(blk_sz, fc_interval);
+	fc = bench_alloc(fc_sz);
+	assert(fc);
+	fc_size = build_fc_block(fc, blk, size, key_sz, fc_interval);
+	t.map = malloc((size > fc_size ? size : fc_size) / 64 + 1);
+	assert(t.map);
+
+	srand(2);
+	fc_bytes = fc_lines = fc_region_bytes = fc_region_lines = 0;
+	for (i = 0; i < SORTED_NPROBE; i++) {
+		cnt = i == SORTED_NPROBE - 1 ? sortidx.ri.nrec - 1 :
+			rand() % sortidx.ri.nrec;
+		probe[i] = ((region_t *)(blk + sortidx.ri.off[cnt]))->key;
+		r = search(blk, size, probe[i], key_sz);
+		v = search_frontcoded(fc, probe[i], key_sz, &vsz);
+		assert(r && v && vsz == r->val_sz);
+		assert(search_binary(blk, size, probe[i], key_sz) == r);
+		assert(memcmp(v, r->key + key_sz, vsz) == 0);
+
+		t.base = blk;
+		t.bytes = t.lines = 0;
+		memset(t.map, 0, size / 64 + 1);
+		region_touch(blk, size, probe[i], key_sz, &t);
+		fc_region_bytes += t.bytes;
+		fc_region_lines += t.lines;
+		t.base = fc;
+		t.bytes = t.lines = 0;
+		memset(t.map, 0, fc_size / 64 + 1);
+		fc_lookup(fc, probe[i], key_sz, &vsz, &t);
+		fc_bytes += t.bytes;
+		fc_lines += t.lines;
+	}
+	fc_bytes /= SORTED_NPROBE;
+	fc_lines /= SORTED_NPROBE;
+	fc_region_bytes /= SORTED_NPROBE;
+	fc_region_lines /= SORTED_NPROBE;
+	free(t.map);
+
+	copy_cache(blk, size, bycmp, 256*1024*1024);
+	fc_region_ns = lookup_ns(search, blk, size, probe, SORTED_NPROBE, key_sz,
+				 rep);
+	fc_binary_ns = lookup_ns(search_binary, blk, size, probe, SORTED_NPROBE,
+				 key_sz, rep);
+	copy_cache(fc, fc_size, bycmp, 256*1024*1024);
+	init_timer(&bm);
+	start_timer(&bm);
+	for (cnt = 0; cnt < rep; cnt++) {
+		v = search_frontcoded(kill_cache(fc), probe[cnt % SORTED_NPROBE],
+				      key_sz, &vsz);
+		assert(v);
+	}
+	stop_timer(&bm);
+	fc_ns = usec_timer(&bm) * 1e3 / rep;
+	bench_free(fc, fc_sz);
+	bench_free(blk, blk_sz);
 }
 
 /* Parameters to main
@@ -266,16 +5338,221 @@ search_bench (char *buf, int size, int rep, char *key, int key_sz,
  * 3) value size
  * 4) block size
  * 5) Rep count 
- * 6) dcache 0-disable 1-enable*/
+ * 6) dcache 0-disable 1-enable
+ * followed by optional name=value parameters:
+ *    threads=N  scan the block with N threads (x86 only)
+ *    prefilter=1  compare the first 8 key bytes of 8 records at once
+ *    pfwidth=N  prefix bytes of the prefilter, 8 (the default), 16 or 32
+ *    keyidx=N   scan a side index of key prefixes (1) and hashes (2)
+ *    sorted=1   also time linear, binary, interpolation and Eytzinger
+ *               lookups in a sorted block, printed as ns per lookup
+ *    hashed=1   also time lookups in a block with a hash table of its
+ *               keys in front, against search() of its records, in ns
+ *               per lookup, and print the size of the table
+ *    frontcoded=1  also time lookups in a block of front-coded keys,
+ *               against search() and search_binary() of the sorted
+ *               region_t block, in ns per lookup,
+ *               and print the bytes and cache lines a lookup reads, with
+ *    restart=N  keys per restart point, 16 by default
+ *    filter=T   check a bloom, blocked (Bloom) or xor filter of the block
+ *               keys first, and report its false positive rate and the
+ *               latency of misses
+ *    bpk=N      filter bits per key, 10 by default
+ *    batch=K    also time batches of K keys looked up by search_many()
+ *               against one search() per key, in ns per key
+ *    kmemeq=1   scan with the equality compare specialized for the key
+ *               size: 8, 10, 16, 32 or 100 bytes, generic otherwise
+ *    kcmp=K     key compare of search(): libc (the default), generic,
+ *               sse2, avx2 or avx512, or auto for the fastest of them on
+ *               keys of key size bytes (x86 only)
+ *    prefetch=D  decode record headers D records ahead of the compare
+ *               and prefetch them, up to 64
+ *    group=G    also time G blocks searched in lock step by
+ *               search_group() against one search() per block, in ns
+ *               per block, up to 16
+ *    file=PATH  also write the block (and its keyidx index) to a block
+ *               file and time searches of its mapping, warm and cold
+ *               (x86 only), with
+ *    advice=A   madvise() of the mapping: none, sequential, random or
+ *               willneed
+ *    huge=1     madvise(MADV_HUGEPAGE) the mapping
+ *    cold=N     number of cold searches, 10 by default
+ *    kdist=D    key sizes: classic (the make_buf() block, the default),
+ *               fixed, uniform, zipf or lognormal.  With a distribution
+ *               other than classic the key and value sizes above are
+ *               the smallest (median for lognormal) sizes and
+ *    vdist=D    value sizes: fixed, uniform, zipf or lognormal
+ *    kmax=N, vmax=N  largest sizes, 4 times the above by default
+ *    zipf=N     Zipf exponent in 1/100, 99 by default
+ *    sigma=N    lognormal sigma in 1/100, 50 by default
+ *    prefix=N   bytes shared by all keys
+ *    hit=N      percent of the lookups in the block, 100 by default
+ *    pos=P      record of the found keys: last, first, middle or random
+ *    lookups=N  number of keys looked up in turn, 64 by default
+ *    seed=N     generator seed
+ *    wlcache=DIR  keep the generated workloads in DIR (x86 only)
+ *    lat=1      also time each lookup of a second pass and print the
+ *               p50, p90, p99, p999 and max latency in ns
+ *    perf=0     do not read the hardware counters of the timed loop
+ *    stream=PATH  also search the block of the block file PATH by
+ *               streaming it from disk, with AIO double buffering and
+ *               with synchronous reads, in MB/s (x86 only), with
+ *    stream_mb=N  first write PATH with a block of N MB (can be larger
+ *               than memory) of the shape of the benchmark block
+ *    chunk=N    read size in KB, rounded up to 4 KB, 4096 by default
+ *    direct=1   read with O_DIRECT instead of dropping the page cache
+ *    passes=N   streaming passes, 1 by default
+ *    uring=DIR  also write `blocks' block files of the benchmark shape
+ *               to DIR, each with its own key, and time lookups of the
+ *               key of a random block through the io_uring engine and
+ *               with one pread() per block, in lookups/s (x86 only), with
+ *    blocks=N   blocks in the set, 16 by default
+ *    qd=N       reads in flight, 8 by default, up to 64
+ *               (direct=1 reads the blocks with O_DIRECT)
+ *    compress=1  also compress `zblocks' blocks of distinct keys and
+ *               time lookups of a random key of a random block through a
+ *               CLOCK cache of decompressed blocks, against search() of
+ *               the blocks left uncompressed, and print the compressed
+ *               sizes and the ns to decompress a block (x86 only), with
+ *    zblocks=N  blocks in the set, 64 by default
+ *    zlevel=N   zlib level, 6 by default, 0 for the delta encoding only
+ *    zdelta=0   no key-prefix delta encoding of the records
+ *    zcache=N   decompressed blocks cached, 16 by default
+ *    zbits=N    random bits per value byte, 4 by default
+ *    readers=N  also run N threads looking the key up in a block that
+ *               a writer thread rebuilds and swaps in, reclaiming the old
+ *               blocks with epochs, and print the reader lookups/s and
+ *               latency percentiles and the publish latency (x86 only),
+ *               with
+ *    reclaim=R  sync to wait for the readers at each publish, defer to
+ *               free the old blocks once their readers are gone
+ *    wperiod=N  us between publishes, 1000 by default, 0 for back to
+ *               back publishes, -1 for no writer
+ *    pages=P    back the block and the cache-defeat arena with malloc,
+ *               thp or hugetlb pages (x86 only)
+ *    node=N     bind them to NUMA node N (x86 only)
+ *    interleave=1  interleave them over the NUMA nodes (x86 only) */
+
+/* Optional parameters, given after the positional ones as name=value */
+typedef struct {
+	const char  *name;
+	int         *val;
+	const char **names;  /* if set, the value is given by its name */
+	char       **str;    /* string parameter, instead of val */
+} bench_opt_t;
+
+bench_opt_t bench_opts[] = {
+	{ "threads", &nthreads },
+	{ "prefilter", &prefilter },
+	{ "pfwidth", &pfwidth, pfwidth_names },
+	{ "keyidx", &keyidx },
+	{ "sorted", &sorted },
+	{ "hashed", &hashed },
+	{ "frontcoded", &frontcoded },
+	{ "restart", &fc_interval },
+	{ "filter", &filter, filter_names },
+	{ "bpk", &filter_bpk },
+	{ "batch", &batch },
+	{ "prefetch", &prefetch },
+	{ "kmemeq", &use_kmemeq },
+	{ "group", &group },
+	{ "perf", &use_perf },
+	{ "lat", &lat },
+	{ "kdist", &wl.kdist, wl_dist_names },
+	{ "vdist", &wl.vdist, wl_dist_names },
+	{ "kmax", &wl.kmax },
+	{ "vmax", &wl.vmax },
+	{ "zipf", &wl.zipf },
+	{ "sigma", &wl.sigma },
+	{ "prefix", &wl.prefix },
+	{ "hit", &wl.hit },
+	{ "pos", &wl.pos, wl_pos_names },
+	{ "lookups", &wl.nlookup },
+	{ "seed", &wl.seed },
+#ifndef MPPA
+	{ "kcmp", &kcmp, kcmp_names },
+	{ "file", NULL, NULL, &blkfile },
+	{ "wlcache", NULL, NULL, &wl.cache },
+	{ "advice", &blkfile_advice, advice_names },
+	{ "huge", &blkfile_huge },
+	{ "cold", &blkfile_cold },
+	{ "stream", NULL, NULL, &stream_path },
+	{ "stream_mb", &stream_mb },
+	{ "chunk", &stream_chunk },
+	{ "direct", &stream_direct },
+	{ "passes", &stream_pass },
+	{ "uring", NULL, NULL, &uring_dir },
+	{ "blocks", &uring_nblk },
+	{ "qd", &uring_qd },
+	{ "compress", &compress_blk },
+	{ "zblocks", &zblocks },
+	{ "zlevel", &zlevel },
+	{ "zdelta", &zdelta },
+	{ "zcache", &zcache },
+	{ "zbits", &zbits },
+	{ "readers", &rcu_readers },
+	{ "reclaim", &rcu_reclaim, reclaim_names },
+	{ "wperiod", &rcu_wperiod },
+	{ "pages", &mem_pages, mem_names },
+	{ "node", &mem_node },
+	{ "interleave", &mem_interleave },
+	{ "wset", &wset, wset_names },
+	{ "wblocks", &wblocks },
+	{ "wtheta", &wtheta },
+	{ "whit", &whit },
+	{ "wflush", &wflush, wflush_names },
+	{ "llc_kb", &llc_kb },
+#endif
+	{ NULL, NULL }
+};
+
+void
+parse_opts(int argc, char *argv[])
+{
+	bench_opt_t *opt;
+	char        *eq;
+	int         cnt;
+
+	for (cnt = 0; cnt < argc; cnt++) {
+		eq = strchr(argv[cnt], '=');
+		for (opt = bench_opts; eq && opt->name; opt++) {
+			if (strlen(opt->name) == (size_t)(eq - argv[cnt]) &&
+			    strncmp(argv[cnt], opt->name, eq - argv[cnt]) == 0)
+				break;
+		}
+		if (!eq || !opt->name) {
+			printf("unknown parameter %s, check source code\n",
+			       argv[cnt]);
+			assert(0);
+		}
+		if (opt->str) {
+			*opt->str = eq + 1;
+			continue;
+		}
+		if (!opt->names) {
+			*opt->val = atoi(eq + 1);
+			continue;
+		}
+		for (*opt->val = 0; opt->names[*opt->val]; (*opt->val)++) {
+			if (strcmp(opt->names[*opt->val], eq + 1) == 0)
+				break;
+		}
+		if (!opt->names[*opt->val]) {
+			printf("unknown value for %s, check source code\n",
+			       argv[cnt]);
+			assert(0);
+		}
+	}
+}
 
 int
 main(int argc, char *argv[])
 {
 	int key_sz, value_sz, blk_sz, rep_cnt;
-	char *ptr;
 	char *key;
 	double  usec;
 	int bycmp;
+	int cnt;
 
 #ifdef __K1__
 	mppa_rpc_client_init();
@@ -288,7 +5565,7 @@ main(int argc, char *argv[])
 	int offset = 0;
 #endif
 
-	if (argc != 7 + offset) {
+	if (argc < 7 + offset) {
 		printf("incorrect arguments, check source code %d\n", argc);
 		assert(0);
 	}
@@ -312,13 +5589,185 @@ main(int argc, char *argv[])
 	/* 6th param, trash dcache */
 	dcache = atoi(argv[6 + offset]);
 
-	ptr = malloc(blk_sz);
-	assert(ptr);
+	parse_opts(argc - 7 - offset, argv + 7 + offset);
+#ifndef MPPA
+	if (mem_node >= 0)
+		mem_numa = "bind";
+	else if (mem_interleave)
+		mem_numa = "interleave";
+#endif
+
 	key = malloc(key_sz);
 	assert(key);
 	memset(key, 0xff, key_sz);
-	search_bench(ptr, blk_sz, rep_cnt, key, key_sz, value_sz,
-		     &usec, &bycmp);
-	printf("#python\nbmtime=%f\nbytecmp=%d\n", usec, bycmp);
+	wl.size = blk_sz;
+	wl.key_sz = key_sz;
+	wl.val_sz = value_sz;
+	wl_init(&wl, key);
+#ifndef MPPA
+	kcmp_init(key_sz);
+#endif
+	search_bench(&wl, rep_cnt, &usec, &bycmp);
+	printf("#python\nbmtime=%f\nbytecmp=%d\nthreads=%d\n", usec, bycmp,
+	       nthreads);
+	if (lat) {
+		printf("lat_p50=%llu\nlat_p90=%llu\nlat_p99=%llu\n",
+		       (unsigned long long)lat_percentile(&lat_hist, 0.50),
+		       (unsigned long long)lat_percentile(&lat_hist, 0.90),
+		       (unsigned long long)lat_percentile(&lat_hist, 0.99));
+		printf("lat_p999=%llu\nlat_max=%llu\n",
+		       (unsigned long long)lat_percentile(&lat_hist, 0.999),
+		       (unsigned long long)lat_hist.max);
+	}
+	printf("perf_events=%d\n", perf_events);
+	for (cnt = 0; cnt < PERF_NEVENT; cnt++)
+		printf("perf_%s=%lld\n", perf_names[cnt],
+		       (long long)perf_count[cnt]);
+	printf("prefilter=%d\npfkernel='%s'\npfwidth=%d\n", prefilter,
+	       pf_kernel_name(), 8 << pfwidth);
+#ifndef MPPA
+	printf("kcmp='%s'\nkcmp_pick='%s'\n", kcmp_names[kcmp],
+	       kcmp_names[kcmp_pick]);
+	for (cnt = 1; cnt < KCMP_NVAR; cnt++) {
+		if (kcmp_ns[cnt] >= 0)
+			printf("kcmp_ns_%s=%f\n", kcmp_names[cnt], kcmp_ns[cnt]);
+	}
+#endif
+	printf("kmemeq=%d\nkmemeq_kernel=%d\n", use_kmemeq,
+	       kmemeq_kernel(key_sz));
+#ifdef SCAN_STATS
+	scan_print("scan", &scan_stats);
+#endif
+	printf("keyidx=%d\n", keyidx);
+	printf("prefetch=%d\n", prefetch);
+	printf("workload='%s'\n", wl_dist_names[wl.kdist]);
+	if (wl.kdist != WL_CLASSIC) {
+		printf("vdist='%s'\nkmax=%d\nvmax=%d\nprefix=%d\nhit=%d\n"
+		       "pos='%s'\nlookups=%d\nseed=%d\nnrec=%d\nwl_cached=%d\n",
+		       wl_dist_names[wl.vdist], wl.kmax, wl.vmax, wl.prefix,
+		       wl.hit, wl_pos_names[wl.pos], wl.nlookup, wl.seed,
+		       wl.nrec, wl_cached);
+	}
+	printf("mem_pages='%s'\nmem_numa='%s'\nmem_node=%d\nmem_huge_kb=%ld\n",
+	       mem_names[mem_pages], mem_numa, mem_node, mem_huge_kb());
+#ifndef MPPA
+	printf("wset='%s'\nwset_copies=%d\nwset_arena_mb=%llu\n",
+	       wset_names[wset], cache_num,
+	       (unsigned long long)(cache_alloc_sz >> 20));
+	printf("llc_kb=%d\nwset_hit=%f\n", llc_kb, wset_hit);
+	if (wset == WSET_ZIPF)
+		printf("wtheta=%d\n", wtheta);
+	else if (wset == WSET_HOT)
+		printf("whit=%d\nwset_hot=%d\n", whit, wset_hot);
+	else if (wset == WSET_FLUSH)
+		printf("wflush='%s'\n", wflush_names[wflush]);
+#endif
+	if (filter) {
+		printf("filter='%s'\nfilter_bpk=%d\nfilter_bytes=%llu\n",
+		       filter_names[filter], filter_bpk,
+		       (unsigned long long)blkfilter.bytes);
+		printf("filter_fpr=%f\nmiss_ns=%f\nmiss_ns_nofilter=%f\n",
+		       filter_fpr, filter_miss_ns, filter_miss_ns_nofilter);
+	}
+	if (batch) {
+		printf("batch=%d\nbatch_ns_many=%f\nbatch_ns_search=%f\n",
+		       batch, batch_ns_many, batch_ns_search);
+#ifdef SCAN_STATS
+		scan_print("scan_batch", &scan_batch);
+#endif
+	}
+	if (group > 0) {
+		printf("group=%d\ngroup_ns_group=%f\ngroup_ns_serial=%f\n",
+		       group, group_ns_group, group_ns_serial);
+#ifdef SCAN_STATS
+		scan_print("scan_group", &scan_group);
+#endif
+	}
+#ifndef MPPA
+	if (blkfile) {
+		printf("file_advice='%s'\nfile_huge=%d\n",
+		       advice_names[blkfile_advice], blkfile_huge);
+		printf("file_warm_ns=%f\nfile_cold_ns=%f\nfile_cold_resident=%f\n",
+		       file_warm_ns, file_cold_ns, file_cold_resident);
+	}
+#endif
+#ifndef MPPA
+	if (stream_path) {
+		stream_bench(key, key_sz, value_sz);
+		printf("stream_blk_sz=%llu\nstream_found=%lld\nstream_chunk_kb=%d\n",
+		       (unsigned long long)stream_blk_sz, (long long)stream_found,
+		       stream_chunk);
+		printf("stream_direct=%d\nstream_mbps=%f\nstream_sync_mbps=%f\n",
+		       stream_direct, stream_mbps, stream_sync_mbps);
+	}
+#endif
+#ifndef MPPA
+	if (uring_dir) {
+		uring_bench(blk_sz, rep_cnt, key, key_sz, value_sz);
+		printf("uring_blocks=%d\nuring_qd=%d\nuring_lps=%f\n"
+		       "uring_sync_lps=%f\n", uring_nblk, uring_qd, uring_lps,
+		       uring_sync_lps);
+		printf("uring_scanned=%f\nuring_sync_scanned=%f\n",
+		       uring_blocks, uring_sync_blocks);
+	}
+#endif
+#ifndef MPPA
+	if (rcu_readers > 0) {
+		rcu_bench(blk_sz, rep_cnt, key, key_sz, value_sz);
+		printf("rcu_readers=%d\nrcu_reclaim='%s'\nrcu_wperiod=%d\n"
+		       "rcu_lps=%f\n", rcu_readers, reclaim_names[rcu_reclaim],
+		       rcu_wperiod, rcu_lps);
+		printf("rcu_p50=%llu\nrcu_p99=%llu\nrcu_p999=%llu\nrcu_max=%llu\n",
+		       (unsigned long long)lat_percentile(&rcu_hist, 0.50),
+		       (unsigned long long)lat_percentile(&rcu_hist, 0.99),
+		       (unsigned long long)lat_percentile(&rcu_hist, 0.999),
+		       (unsigned long long)rcu_hist.max);
+		printf("rcu_publishes=%llu\nrcu_pub_p50=%llu\nrcu_pub_p99=%llu\n"
+		       "rcu_pub_max=%llu\nrcu_pending_max=%d\n",
+		       (unsigned long long)rcu_pub_hist.n,
+		       (unsigned long long)lat_percentile(&rcu_pub_hist, 0.50),
+		       (unsigned long long)lat_percentile(&rcu_pub_hist, 0.99),
+		       (unsigned long long)rcu_pub_hist.max, rcu_pending_max);
+	}
+	if (compress_blk) {
+		zblk_bench(blk_sz, rep_cnt, key, key_sz, value_sz);
+		printf("zblocks=%d\nzlevel=%d\nzdelta=%d\nzcache=%d\nzbits=%d\n",
+		       zblocks, zlevel, zdelta, zcache, zbits);
+		printf("zraw_bytes=%llu\nzdelta_bytes=%llu\nzcomp_bytes=%llu\n"
+		       "zratio=%f\n", (unsigned long long)zraw_bytes,
+		       (unsigned long long)zdelta_bytes,
+		       (unsigned long long)zcomp_bytes,
+		       (double)zraw_bytes / zcomp_bytes);
+		printf("zdecomp_ns=%f\nzdecomp_mbps=%f\n", zdecomp_ns,
+		       blk_sz / zdecomp_ns * 1e3);
+		printf("zlookup_ns=%f\nzraw_ns=%f\nzhit_ratio=%f\nzlps=%f\n",
+		       zlookup_ns, zraw_ns, zhit_ratio, 1e9 / zlookup_ns);
+	}
+#endif
+	if (sorted) {
+		double ns[SORTED_NSTRAT];
+		int    strat;
+
+		sorted_bench(blk_sz, rep_cnt, key, key_sz, value_sz, ns);
+		for (strat = 0; strat < SORTED_NSTRAT; strat++)
+			printf("sorted_ns_%s=%f\n", sorted_names[strat], ns[strat]);
+	}
+	if (hashed) {
+		hashed_bench(blk_sz, rep_cnt, key, key_sz, value_sz);
+		printf("hashed_ns=%f\nhashed_linear_ns=%f\n", hashed_ns,
+		       hashed_linear_ns);
+		printf("hashed_table_bytes=%llu\nhashed_overhead=%f\n"
+		       "hashed_load=%f\n", (unsigned long long)hashed_table_bytes,
+		       (double)hashed_table_bytes / blk_sz, hashed_load);
+	}
+	if (frontcoded) {
+		fc_bench(blk_sz, rep_cnt, key, key_sz, value_sz);
+		printf("fc_restart=%d\nfc_size=%d\nfc_ns=%f\nfc_region_ns=%f\n"
+		       "fc_binary_ns=%f\n", fc_interval, fc_size, fc_ns,
+		       fc_region_ns, fc_binary_ns);
+		printf("fc_bytes=%f\nfc_lines=%f\nfc_region_bytes=%f\n"
+		       "fc_region_lines=%f\n", fc_bytes, fc_lines,
+		       fc_region_bytes, fc_region_lines);
+	}
 	return 0;
 }
@@ -0,0 +1,255 @@
+#! /usr/bin/env python3
+"""Parallel, resumable sweep runner for search-bench.
+
+A sweep is a list of cells, each one search-bench command line.  Every
+run of a cell is appended as one JSON line to a results database, so an
+interrupted sweep is resumed by running it again with the same database:
+the repeats already in it are not run again.  Independent cells run
+concurrently, each pinned to its own set of cores, and the summary gives
+the mean of every printed value with a 95% confidence interval over the
+repeats.
+
+    sweep.py run --db results.jsonl -j 4 --repeats 5 \\
+        --blk 65536 1048576 --key 16 100 --val 100 1024 --opts "lat=1"
+    sweep.py csv --db results.jsonl > results.csv
+"""
+
+import argparse
+import ast
+import concurrent.futures
+import csv
+import json
+import math
+import os
+import queue
+import shlex
+import subprocess
+import sys
+import time
+
+HOST = "./search-x86"
+MHZ = 500
+
+# two-sided 95% Student t, by degrees of freedom
+T95 = [0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+       2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+       2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+       2.048, 2.045, 2.042]
+
+
+def cell(cmd, key_sz, val_sz, blk_sz, rep, dcache, opts="", mhz=MHZ):
+    """A cell of the sweep, opts are name=value parameters"""
+    return {"cmd": cmd, "mhz": mhz, "key_sz": key_sz, "val_sz": val_sz,
+            "blk_sz": blk_sz, "rep": rep, "dcache": dcache,
+            "opts": " ".join(opts.split())}
+
+
+def cell_key(c):
+    return "%s %d %d %d %d %d %d %s" % (c["cmd"], c["mhz"], c["key_sz"],
+                                        c["val_sz"], c["blk_sz"], c["rep"],
+                                        c["dcache"], c["opts"])
+
+
+def parse_output(out):
+    """name=value lines of the #python block, without eval()"""
+    res = {}
+    lines = out.splitlines()
+    if "#python" not in lines:
+        raise ValueError("no #python block")
+    for line in lines[lines.index("#python") + 1:]:
+        name, eq, value = line.partition("=")
+        if not eq or not name.isidentifier():
+            continue
+        res[name] = ast.literal_eval(value.strip())
+    return res
+
+
+def load_db(path):
+    """The runs of a results database, by cell key"""
+    runs = {}
+    if not os.path.exists(path):
+        return runs
+    with open(path) as f:
+        for line in f:
+            try:
+                run = json.loads(line)
+            except ValueError:
+                continue    # torn last line of an interrupted sweep
+            runs.setdefault(run["key"], []).append(run)
+    return runs
+
+
+def ok_runs(runs, key):
+    return [r for r in runs.get(key, []) if r["ok"]]
+
+
+def core_slots(cpus, per_cell):
+    cpus = sorted(cpus)
+    return [cpus[i:i + per_cell]
+            for i in range(0, len(cpus) - per_cell + 1, per_cell)]
+
+
+def parse_cpus(spec):
+    cpus = set()
+    for part in spec.split(","):
+        lo, _, hi = part.partition("-")
+        cpus.update(range(int(lo), int(hi or lo) + 1))
+    return cpus
+
+
+def run_cell(c, cores, timeout):
+    # taskset pins the child, the threads of the pool must not fork
+    # through a preexec_fn
+    cmd = ["taskset", "-c", ",".join(str(cpu) for cpu in cores)]
+    cmd += shlex.split(c["cmd"]) + [str(c[k]) for k in
+                                   ("mhz", "key_sz", "val_sz", "blk_sz",
+                                    "rep", "dcache")]
+    cmd += c["opts"].split()
+    run = {"key": cell_key(c), "cell": c, "cores": cores,
+           "start": time.time(), "ok": False}
+    try:
+        p = subprocess.run(cmd, stdout=subprocess.PIPE,
+                           stderr=subprocess.PIPE, timeout=timeout,
+                           universal_newlines=True)
+        if p.returncode != 0:
+            run["error"] = "exit %d: %s" % (p.returncode, p.stderr[-200:])
+        else:
+            run["result"] = parse_output(p.stdout)
+            run["ok"] = True
+    except (OSError, ValueError, SyntaxError,
+            subprocess.TimeoutExpired) as e:
+        run["error"] = str(e)
+    run["secs"] = time.time() - run["start"]
+    return run
+
+
+def run_sweep(cells, db, jobs=1, repeats=1, cpus=None, cores_per_cell=1,
+              timeout=None, retries=1, log=sys.stderr):
+    """Run what the database misses of repeats runs of each cell"""
+    runs = load_db(db)
+    todo = []
+    for c in cells:
+        key = cell_key(c)
+        failed = len(runs.get(key, [])) - len(ok_runs(runs, key))
+        if failed > retries:
+            continue
+        todo += [c] * (repeats - len(ok_runs(runs, key)))
+    if cpus is None:
+        cpus = os.sched_getaffinity(0)
+    slots = queue.Queue()
+    for s in core_slots(cpus, cores_per_cell)[:jobs]:
+        slots.put(s)
+    if slots.empty():
+        raise ValueError("not enough cores for %d per cell" % cores_per_cell)
+
+    def work(c):
+        cores = slots.get()
+        try:
+            return run_cell(c, cores, timeout)
+        finally:
+            slots.put(cores)
+
+    done = 0
+    with open(db, "a") as f, \
+            concurrent.futures.ThreadPoolExecutor(slots.qsize()) as ex:
+        for fut in concurrent.futures.as_completed(
+                [ex.submit(work, c) for c in todo]):
+            run = fut.result()
+            f.write(json.dumps(run, sort_keys=True) + "\n")
+            f.flush()
+            done += 1
+            if log:
+                log.write("[%d/%d] %s %s\n" % (done, len(todo),
+                          "ok" if run["ok"] else "FAILED:", run["key"]
+                          if run["ok"] else run["error"] + " " + run["key"]))
+    return load_db(db)
+
+
+def mean_ci(xs):
+    """mean and half width of its 95% confidence interval"""
+    n = len(xs)
+    m = sum(xs) / n
+    if n < 2:
+        return m, float("nan")
+    sd = math.sqrt(sum((x - m) ** 2 for x in xs) / (n - 1))
+    t = T95[n - 1] if n - 1 < len(T95) else 1.96
+    return m, t * sd / math.sqrt(n)
+
+
+def summary(runs, key):
+    """name -> (mean, ci, n) of the numeric values of the runs of a cell"""
+    ok = ok_runs(runs, key)
+    res = {}
+    for name in sorted(set(k for r in ok for k in r["result"])):
+        xs = [r["result"][name] for r in ok if name in r["result"]]
+        if all(isinstance(x, (int, float)) for x in xs):
+            m, ci = mean_ci(xs)
+            res[name] = (m, ci, len(xs))
+    return res
+
+
+def write_csv(runs, out, metrics=None):
+    rows = []
+    names = set()
+    for key in sorted(runs):
+        s = summary(runs, key)
+        if not s:
+            continue
+        c = runs[key][0]["cell"]
+        names.update(s)
+        rows.append((c, s))
+    names = sorted(n for n in names if not metrics or n in metrics)
+    w = csv.writer(out)
+    params = ["cmd", "key_sz", "val_sz", "blk_sz", "rep", "dcache", "opts"]
+    w.writerow(params + ["n"] +
+               [h for n in names for h in (n, n + "_ci95")])
+    for c, s in rows:
+        n = max(v[2] for v in s.values())
+        w.writerow([c[p] for p in params] + [n] +
+                   [x for name in names
+                    for x in (s[name][:2] if name in s else ("", ""))])
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    sub = ap.add_subparsers(dest="what")
+    r = sub.add_parser("run", help="run or resume a sweep")
+    r.add_argument("--db", default="results.jsonl")
+    r.add_argument("--bin", default=HOST)
+    r.add_argument("--mhz", type=int, default=MHZ)
+    r.add_argument("--blk", type=int, nargs="+", default=[65536])
+    r.add_argument("--key", type=int, nargs="+", default=[16])
+    r.add_argument("--val", type=int, nargs="+", default=[100])
+    r.add_argument("--rep", type=int, default=1000)
+    r.add_argument("--dcache", type=int, nargs="+", default=[0])
+    r.add_argument("--opts", nargs="+", default=[""],
+                   help="one cell per option string")
+    r.add_argument("-j", "--jobs", type=int, default=1)
+    # compare.py needs 4 or more repeats a side to reach p < 0.05
+    r.add_argument("--repeats", type=int, default=5)
+    r.add_argument("--cpus", help="cores to use, e.g. 2-7,10")
+    r.add_argument("--cores-per-cell", type=int, default=1)
+    r.add_argument("--timeout", type=float)
+    r.add_argument("--retries", type=int, default=1,
+                   help="failed runs of a cell before it is skipped")
+    c = sub.add_parser("csv", help="summary of a results database")
+    c.add_argument("--db", default="results.jsonl")
+    c.add_argument("--metrics", nargs="+")
+    a = ap.parse_args()
+
+    if a.what == "run":
+        cells = [cell(a.bin, k, v, b, a.rep, d, o, a.mhz)
+                 for b in a.blk for k in a.key for v in a.val
+                 for d in a.dcache for o in a.opts
+                 if b >= k + v + 16]
+        run_sweep(cells, a.db, a.jobs, a.repeats,
+                  parse_cpus(a.cpus) if a.cpus else None,
+                  a.cores_per_cell, a.timeout, a.retries)
+    elif a.what == "csv":
+        write_csv(load_db(a.db), sys.stdout, a.metrics)
+    else:
+        ap.print_help()
+
+
+if __name__ == "__main__":
+    main()